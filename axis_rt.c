@@ -0,0 +1,236 @@
+/*
+*********************************************************************************************************
+*                                             AXIS_RT_C
+*********************************************************************************************************
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "motor_func.h"
+#include "estop.h"
+#include "rpi_func.h"
+#include "axis_rt.h"
+
+/*
+*********************************************************************************************************
+*                                      PER-AXIS THREAD VARIABLE
+*********************************************************************************************************
+*/
+struct axis {
+    int                 wheel_direction;
+    int                 mode;
+    int                 cpu;
+    pthread_t           thread;
+    struct axis_shared  shared;
+};
+
+static struct axis      axes[AXIS_MAX];
+static int              axis_num = 0;
+static atomic_int       axis_run;
+static struct timespec  axis_epoch;     // 모든 축이 공유하는 시간 기준
+
+static void timespec_add_ns(struct timespec *t, long ns)
+{
+    t->tv_nsec += ns;
+    while(t->tv_nsec >= 1000000000L){
+        t->tv_nsec -= 1000000000L;
+        t->tv_sec++;
+    }
+}
+
+static int timespec_before(const struct timespec *a, const struct timespec *b)
+{
+    return (a->tv_sec < b->tv_sec) | ((a->tv_sec == b->tv_sec) & (a->tv_nsec < b->tv_nsec));
+}
+
+/*
+* 축 제어 스레드
+* axis_epoch + n * AXIS_PERIOD_NS 시각마다 제어 함수를 1번 실행.
+* 주기를 놓치면 다음 주기 경계로 건너뛰어 다른 축과의 위상을 유지함.
+*/
+static void *axis_thread(void *arg)
+{
+    struct axis *ax = (struct axis *)arg;
+    struct timespec next = axis_epoch, now;
+    int ref, dir, err;
+
+    while(atomic_load_explicit(&axis_run, memory_order_acquire)){
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+        ref = atomic_load_explicit(&ax->shared.ref, memory_order_relaxed);
+        dir = atomic_load_explicit(&ax->shared.move_direction, memory_order_relaxed);
+
+        if(ax->mode == AXIS_VEL)    err = vel_control(ref, ax->wheel_direction, dir);
+        else                        err = pos_control(ref, ax->wheel_direction, dir);
+
+        atomic_store_explicit(&ax->shared.err, err, memory_order_relaxed);
+        atomic_fetch_add_explicit(&ax->shared.tick, 1, memory_order_release);
+
+        //spi 버스가 복구되지 않으면 정지
+        if(motor_health(ax->wheel_direction) == SPI_ST_FAILED) estop_fire(ESTOP_SRC_CONTROL);
+
+        timespec_add_ns(&next, AXIS_PERIOD_NS);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        while(timespec_before(&next, &now)){
+            atomic_fetch_add_explicit(&ax->shared.overrun, 1, memory_order_relaxed);
+            timespec_add_ns(&next, AXIS_PERIOD_NS);
+        }
+    }
+    return NULL;
+}
+
+/*
+*********************************************************************************************************
+*                                      PER-AXIS THREAD FUNC
+*********************************************************************************************************
+*/
+
+/*
+* 제어 축 추가 함수
+* int axis_rt_add(int wheel_direction, int mode, int cpu)
+* 입력 값 : wheel_direction ==> LEFT_WHEEL / RIGHT_WHEEL
+*         mode ==> AXIS_POS / AXIS_VEL
+*         cpu ==> 스레드를 고정할 코어 번호 (-1 이면 고정하지 않음)
+* 반환 값 : 성공 축 번호 / 실패 -1
+* 설명 : axis_rt_start() 이전에 호출할 것.
+*/
+int axis_rt_add(int wheel_direction, int mode, int cpu)
+{
+    struct axis *ax;
+
+    if(axis_num >= AXIS_MAX)                                                    return -1;
+    if(atomic_load(&axis_run))                                                  return -1;
+    if( (wheel_direction != LEFT_WHEEL) & (wheel_direction != RIGHT_WHEEL) )    return -1;
+    if( (mode != AXIS_POS) & (mode != AXIS_VEL) )                               return -1;
+
+    ax = &axes[axis_num];
+    ax->wheel_direction = wheel_direction;
+    ax->mode            = mode;
+    ax->cpu             = cpu;
+    atomic_init(&ax->shared.ref, 0);
+    atomic_init(&ax->shared.move_direction, FORWARD);
+    atomic_init(&ax->shared.err, 0);
+    atomic_init(&ax->shared.tick, 0);
+    atomic_init(&ax->shared.overrun, 0);
+
+    return axis_num++;
+}
+
+/*
+* 축 제어 스레드 시작 함수
+* int axis_rt_start(void)
+* 입력 값 : 없음
+* 반환 값 : 성공 0 / 실패 -1
+* 설명 : 메모리를 고정(mlockall)하고 축마다 SCHED_FIFO 스레드를 지정된 코어에 생성.
+*       모든 스레드는 AXIS_START_DELAY_NS 후의 같은 시각에 첫 tick을 실행.
+*       실시간 스케줄링 권한이 없으면 일반 스레드로 실행됨.
+*       제어 함수가 매 tick printf 하는 디버그 옵션(motor_func.h M_DEBUG, E_DEBUG, PI_DEBUG)이 켜져 있으면 경고만 출력
+*       (주기를 놓칠 수 있음, overrun 으로 확인).
+*/
+int axis_rt_start(void)
+{
+    struct sched_param param = {0,};
+    pthread_attr_t attr;
+    cpu_set_t cpus;
+    int i, ret = 0;
+
+    if(axis_num == 0) return -1;
+
+#if defined(M_DEBUG) || defined(E_DEBUG) || defined(PI_DEBUG)
+    printf("axis rt : M_DEBUG, E_DEBUG, PI_DEBUG print in every control tick, expect overruns\n");
+#endif
+
+    if(mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+        printf("axis mlockall error\n");
+
+    clock_gettime(CLOCK_MONOTONIC, &axis_epoch);
+    timespec_add_ns(&axis_epoch, AXIS_START_DELAY_NS);
+    atomic_store(&axis_run, 1);
+
+    for(i=0; i<axis_num; i++){
+        pthread_attr_init(&attr);
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        param.sched_priority = AXIS_RT_PRIORITY;
+        pthread_attr_setschedparam(&attr, &param);
+        if(axes[i].cpu >= 0){
+            CPU_ZERO(&cpus);
+            CPU_SET(axes[i].cpu, &cpus);
+            pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+        }
+
+        if((ret = pthread_create(&axes[i].thread, &attr, axis_thread, &axes[i])) != 0){
+            //실시간 권한이 없는 경우 일반 스레드로 재시도
+            pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+            ret = pthread_create(&axes[i].thread, &attr, axis_thread, &axes[i]);
+        }
+        pthread_attr_destroy(&attr);
+
+        if(ret != 0){
+            printf("axis %d thread create error\n", i);
+            axis_num = i;
+            axis_rt_stop();
+            return -1;
+        }
+#ifdef M_DEBUG
+        printf("AXIS %d : %s WHEEL %s cpu %d\n", i, (axes[i].wheel_direction == LEFT_WHEEL) ? "LEFT" : "RIGHT",\
+                                                 (axes[i].mode == AXIS_VEL) ? "VEL" : "POS", axes[i].cpu);
+#endif
+    }
+    return 0;
+}
+
+/*
+* 축 제어 스레드 종료 함수
+* void axis_rt_stop(void)
+* 입력 값 : 없음
+* 반환 값 : 없음
+*/
+void axis_rt_stop(void)
+{
+    int i;
+
+    if(!atomic_exchange(&axis_run, 0)) return;
+    for(i=0; i<axis_num; i++)
+        pthread_join(axes[i].thread, NULL);
+}
+
+/*
+* 축 목표 값 설정 함수 (임의의 스레드에서 호출 가능)
+* int axis_set_ref(int axis, int ref, int move_direction)
+* 입력 값 : axis ==> axis_rt_add() 반환 값
+*         ref ==> 목표 값
+*         move_direction ==> FORWARD / BACKWARD
+* 반환 값 : 성공 0 / 실패 -1
+*/
+int axis_set_ref(int axis, int ref, int move_direction)
+{
+    if( (axis < 0) | (axis >= axis_num) ) return -1;
+
+    atomic_store_explicit(&axes[axis].shared.move_direction, move_direction, memory_order_relaxed);
+    atomic_store_explicit(&axes[axis].shared.ref, ref, memory_order_release);
+    return 0;
+}
+
+/*
+* 축 상태 읽기 함수 (임의의 스레드에서 호출 가능)
+* int axis_get_state(int axis, int *err, unsigned int *tick, unsigned int *overrun)
+* 입력 값 : axis ==> axis_rt_add() 반환 값
+*         err, tick, overrun ==> 값을 받아올 변수 (NULL 가능)
+* 반환 값 : 성공 0 / 실패 -1
+*/
+int axis_get_state(int axis, int *err, unsigned int *tick, unsigned int *overrun)
+{
+    if( (axis < 0) | (axis >= axis_num) ) return -1;
+
+    if(tick)    *tick       = atomic_load_explicit(&axes[axis].shared.tick, memory_order_acquire);
+    if(err)     *err        = atomic_load_explicit(&axes[axis].shared.err, memory_order_relaxed);
+    if(overrun) *overrun    = atomic_load_explicit(&axes[axis].shared.overrun, memory_order_relaxed);
+    return 0;
+}
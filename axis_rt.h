@@ -0,0 +1,50 @@
+/*
+*********************************************************************************************************
+*                                              AXIS_RT.H
+*********************************************************************************************************
+*/
+#ifndef __AXIS_RT_H__
+#define __AXIS_RT_H__
+
+#include <stdatomic.h>
+
+/*
+*********************************************************************************************************
+*                                  PER-AXIS REAL-TIME CONTROL THREAD
+* 축(바퀴)마다 독립된 실시간 제어 스레드를 생성하여 각각 다른 코어에 고정(affinity)시킴.
+* 축별로 다른 spi 버스를 사용하려면 rpi_spi_setup_bus() + motor_set_spi() 로 먼저 채널을 연결할 것.
+* 모든 스레드는 공통 시작 시각(axis_epoch)을 기준으로 n * AXIS_PERIOD_NS 시각에 깨어나므로
+* 축 간의 제어 주기 위상이 맞춰짐.
+* 축 간 정보 교환(명령, 상태)은 lock-free 원자 변수(struct axis_shared)로만 이루어짐.
+* 각 축은 자신의 목표(ref)만 따라가며 다른 축의 상태를 제어에 사용하지 않음(교차 결합 없음).
+* 두 바퀴의 진행량을 맞춰야 하는 경우(직진, 원호 주행)에는 한 루프에서 sync_control()을 사용할 것.
+*********************************************************************************************************
+*/
+#define AXIS_MAX            4
+#define AXIS_PERIOD_NS      ((long)(dT * 1000000000L))  // 제어 주기 (dT)
+#define AXIS_RT_PRIORITY    80                          // SCHED_FIFO 우선순위
+#define AXIS_START_DELAY_NS 10000000L                   // 시작 시각 여유 10ms
+
+#define AXIS_POS    0   // 위치 제어 (pos_control)
+#define AXIS_VEL    1   // 속도 제어 (vel_control)
+
+// 축 간 공유 상태. 모든 멤버는 원자적으로 접근.
+struct axis_shared {
+    atomic_int      ref;            // 목표 값 (AXIS_POS : degree / AXIS_VEL : degree/sec)
+    atomic_int      move_direction; // FORWARD / BACKWARD
+    atomic_int      err;            // 마지막 tick의 제어 오차
+    atomic_uint     tick;           // 실행된 tick 수
+    atomic_uint     overrun;        // 주기를 놓친 횟수
+};
+
+/*
+*********************************************************************************************************
+*                                              PREDEFINE FUNCTION
+*********************************************************************************************************
+*/
+int axis_rt_add(int wheel_direction, int mode, int cpu);
+int axis_rt_start(void);
+void axis_rt_stop(void);
+int axis_set_ref(int axis, int ref, int move_direction);
+int axis_get_state(int axis, int *err, unsigned int *tick, unsigned int *overrun);
+#endif
@@ -0,0 +1,315 @@
+/*
+*********************************************************************************************************
+*                                             CTRL_LOOP_C
+*********************************************************************************************************
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include "rate_mgr.h"
+#include "ctrl_loop.h"
+
+/*
+*********************************************************************************************************
+*                                        EPOLL CONTROL RUNTIME VARIABLE
+*********************************************************************************************************
+*/
+struct loop_src {
+    int             fd;
+    loop_src_fn     fn;
+    void            *arg;
+};
+
+static int              loop_epfd = -1;
+static int              loop_tfd = -1;
+static int              loop_sfd = -1;
+static sigset_t         loop_mask;
+static volatile int     loop_running = 0;
+static int              loop_exit_signo = 0;
+
+static loop_tick_fn     loop_tick = NULL;
+static void             *loop_tick_arg = NULL;
+static loop_reload_fn   loop_reload = NULL;
+static void             *loop_reload_arg = NULL;
+
+static struct loop_src  loop_srcs[LOOP_MAX_SRC];    // 등록 순서 = 처리 순서
+static int              loop_nsrc = 0;
+
+/*
+* timerfd 를 절대 시각 at 에 1번 만료되도록 설정 (지난 시각이면 즉시 만료)
+*/
+static int loop_arm(const struct timespec *at)
+{
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    its.it_value = *at;
+    if( (its.it_value.tv_sec == 0) & (its.it_value.tv_nsec == 0) ) its.it_value.tv_nsec = 1;   // 0 은 해제
+    return timerfd_settime(loop_tfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/*
+* tick 처리. timerfd 가 만료되었으면 제어 함수를 실행하고 다음 tick 을 설정.
+* 반환 값 : 실행 1 / 만료되지 않음 0 / 종료 요청 -1
+*/
+static int loop_do_tick(void)
+{
+    struct timespec next;
+    uint64_t expired;
+    int ret = 0;
+
+    if(read(loop_tfd, &expired, sizeof(expired)) != sizeof(expired)) return 0;
+
+    rate_mark();
+    if(loop_tick) ret = loop_tick(loop_tick_arg);
+    rate_update(&next);
+    loop_arm(&next);
+
+    return (ret < 0) ? -1 : 1;
+}
+
+/*
+* signalfd 처리. SIGHUP 은 설정 다시 읽기, 나머지는 loop 종료.
+*/
+static void loop_do_signal(void)
+{
+    struct signalfd_siginfo si;
+
+    while(read(loop_sfd, &si, sizeof(si)) == sizeof(si)){
+        if(si.ssi_signo == SIGHUP){
+            if(loop_reload) loop_reload(loop_reload_arg);
+            rate_command();
+            loop_request_tick();
+        }
+        else{
+            loop_exit_signo = si.ssi_signo;
+            loop_running    = 0;
+        }
+    }
+}
+
+/*
+*********************************************************************************************************
+*                                        EPOLL CONTROL RUNTIME FUNC
+*********************************************************************************************************
+*/
+
+/*
+* 이벤트 루프 초기화 함수
+* int loop_init(void)
+* 입력 값 : 없음
+* 반환 값 : 성공 0 / 실패 -1
+* 설명 : SIGINT, SIGTERM, SIGHUP 을 block 하고 signalfd 로 받음. 이후 생성되는 스레드도 mask 를 상속함.
+*/
+int loop_init(void)
+{
+    struct epoll_event ev;
+
+    if(loop_epfd >= 0) return -1;
+
+    sigemptyset(&loop_mask);
+    sigaddset(&loop_mask, SIGINT);
+    sigaddset(&loop_mask, SIGTERM);
+    sigaddset(&loop_mask, SIGHUP);
+    if(sigprocmask(SIG_BLOCK, &loop_mask, NULL) < 0){
+        printf("loop sigprocmask error\n");
+        return -1;
+    }
+
+    loop_epfd   = epoll_create1(EPOLL_CLOEXEC);
+    loop_tfd    = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    loop_sfd    = signalfd(-1, &loop_mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if( (loop_epfd < 0) | (loop_tfd < 0) | (loop_sfd < 0) ){
+        printf("loop fd create error\n");
+        loop_close();
+        return -1;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events   = EPOLLIN;
+    ev.data.fd  = loop_tfd;
+    if(epoll_ctl(loop_epfd, EPOLL_CTL_ADD, loop_tfd, &ev) < 0){
+        loop_close();
+        return -1;
+    }
+    ev.data.fd  = loop_sfd;
+    if(epoll_ctl(loop_epfd, EPOLL_CTL_ADD, loop_sfd, &ev) < 0){
+        loop_close();
+        return -1;
+    }
+
+    loop_nsrc = 0;
+    return 0;
+}
+
+/*
+* 제어 tick / 설정 다시 읽기 함수 등록
+* int loop_set_tick(loop_tick_fn fn, void *arg)
+* int loop_set_reload(loop_reload_fn fn, void *arg)
+* 반환 값 : 성공 0
+*/
+int loop_set_tick(loop_tick_fn fn, void *arg)
+{
+    loop_tick       = fn;
+    loop_tick_arg   = arg;
+    return 0;
+}
+
+int loop_set_reload(loop_reload_fn fn, void *arg)
+{
+    loop_reload     = fn;
+    loop_reload_arg = arg;
+    return 0;
+}
+
+/*
+* 입력 source 등록/제거 함수
+* int loop_add_source(int fd, loop_src_fn fn, void *arg)
+* int loop_del_source(int fd)
+* 입력 값 : fd ==> 읽기 가능할 때 fn(fd, arg)을 호출할 파일 디스크립터 (fd 는 호출한 쪽에서 닫음)
+* 반환 값 : 성공 0 / 실패 -1
+* 설명 : fn 이 0 보다 작은 값을 반환하면(EOF 등) 자동으로 제거됨.
+*       epoll 로 감시할 수 없는 fd(일반 파일, /dev/null 등)는 EPERM 으로 실패하므로 반환 값을 확인할 것.
+*/
+int loop_add_source(int fd, loop_src_fn fn, void *arg)
+{
+    struct epoll_event ev;
+
+    if( (loop_epfd < 0) | (fd < 0) | (fn == NULL) )    return -1;
+    if(loop_nsrc >= LOOP_MAX_SRC)                       return -1;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events   = EPOLLIN;
+    ev.data.fd  = fd;
+    if(epoll_ctl(loop_epfd, EPOLL_CTL_ADD, fd, &ev) < 0){
+        printf("loop source %d add error\n", fd);
+        return -1;
+    }
+    loop_srcs[loop_nsrc].fd     = fd;
+    loop_srcs[loop_nsrc].fn     = fn;
+    loop_srcs[loop_nsrc].arg    = arg;
+    loop_nsrc++;
+    return 0;
+}
+
+int loop_del_source(int fd)
+{
+    int i;
+
+    for(i=0; i<loop_nsrc; i++){
+        if(loop_srcs[i].fd != fd) continue;
+
+        epoll_ctl(loop_epfd, EPOLL_CTL_DEL, fd, NULL);
+        for(; i<loop_nsrc-1; i++) loop_srcs[i] = loop_srcs[i+1];
+        loop_nsrc--;
+        return 0;
+    }
+    return -1;
+}
+
+/*
+* tick 즉시 요청 함수
+* void loop_request_tick(void)
+* 설명 : idle 주기로 대기 중이면 다음 tick 을 바로 실행. (full 주기에서는 다음 tick 이 1 주기 이내)
+*       명령 처리 후 rate_command()와 함께 호출.
+*/
+void loop_request_tick(void)
+{
+    struct timespec now;
+
+    if( (loop_tfd < 0) | !rate_is_idle() ) return;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    loop_arm(&now);
+}
+
+/*
+* 이벤트 루프 실행 함수
+* int loop_run(void)
+* 입력 값 : 없음
+* 반환 값 : 종료 시그널 번호 / tick 함수, loop_stop()으로 종료 0 / 실패 -1
+* 설명 : 첫 tick 은 바로 실행. 매 epoll 이벤트마다 tick --> signal --> source(등록 순서) 순서로 처리하고,
+*       source 처리 사이에도 tick 을 확인함.
+*/
+int loop_run(void)
+{
+    struct epoll_event ev[LOOP_MAX_EVENTS];
+    int ready[LOOP_MAX_EVENTS];
+    int n, i, k, nready;
+    struct loop_src *src;
+    struct timespec now;
+
+    if(loop_epfd < 0) return -1;
+
+    loop_exit_signo = 0;
+    loop_running    = 1;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    loop_arm(&now);
+
+    while(loop_running){
+        if((n = epoll_wait(loop_epfd, ev, LOOP_MAX_EVENTS, -1)) < 0){
+            if(errno == EINTR) continue;
+            printf("loop epoll_wait error\n");
+            break;
+        }
+
+        //1. 제어 tick
+        if(loop_do_tick() < 0) break;
+
+        //2. 시그널
+        for(i=0; i<n; i++)
+            if(ev[i].data.fd == loop_sfd) loop_do_signal();
+
+        //3. 입력 source (등록 순서), 처리 사이마다 tick 확인
+        nready = 0;
+        for(k=0; k<loop_nsrc; k++)
+            for(i=0; i<n; i++)
+                if(ev[i].data.fd == loop_srcs[k].fd) ready[nready++] = loop_srcs[k].fd;
+
+        for(i=0; (i < nready) & loop_running; i++){
+            for(k=0, src=NULL; k<loop_nsrc; k++)
+                if(loop_srcs[k].fd == ready[i]) src = &loop_srcs[k];
+            if(src == NULL) continue;   // 앞의 source 에서 제거됨
+
+            if(src->fn(src->fd, src->arg) < 0) loop_del_source(ready[i]);
+            if(loop_do_tick() < 0) loop_running = 0;
+        }
+    }
+
+    loop_running = 0;
+    return loop_exit_signo;
+}
+
+/*
+* 이벤트 루프 종료 요청 (tick, source 함수 안에서 호출)
+* void loop_stop(void)
+*/
+void loop_stop(void)
+{
+    loop_running = 0;
+}
+
+/*
+* 이벤트 루프 정리 함수
+* void loop_close(void)
+* 설명 : fd 를 닫고 시그널 mask 를 되돌림. 대기 중이던 SIGINT 등은 이때 전달될 수 있으므로 정지 처리 후 호출할 것.
+*/
+void loop_close(void)
+{
+    if(loop_sfd >= 0)   close(loop_sfd);
+    if(loop_tfd >= 0)   close(loop_tfd);
+    if(loop_epfd >= 0)  close(loop_epfd);
+    loop_sfd    = -1;
+    loop_tfd    = -1;
+    loop_epfd   = -1;
+    loop_nsrc   = 0;
+    sigprocmask(SIG_UNBLOCK, &loop_mask, NULL);
+}
@@ -0,0 +1,45 @@
+/*
+*********************************************************************************************************
+*                                              CTRL_LOOP.H
+*********************************************************************************************************
+*/
+#ifndef __CTRL_LOOP_H__
+#define __CTRL_LOOP_H__
+
+/*
+*********************************************************************************************************
+*                                          EPOLL CONTROL RUNTIME
+* 스레드 없이 epoll 하나로 제어 tick 과 외부 입력을 처리.
+*   timerfd  : 제어 tick. 주기는 rate_mgr.c 가 매 tick 결정 (절대 시각, one-shot)
+*   signalfd : SIGINT, SIGTERM ==> loop 종료 (이후 호출한 쪽에서 DAC 0 출력, 브레이크)
+*              SIGHUP          ==> 설정 다시 읽기 (loop_set_reload())
+*   source   : loop_add_source()로 등록한 fd (명령 입력 등). 등록 순서대로 처리. pipe, tty, socket 만 가능
+* 우선순위 : tick > signal > source. source 처리 사이마다 timerfd 를 확인하여 tick 이 밀리지 않게 함.
+* SIGSEGV 등 동기 시그널은 signalfd 로 받을 수 없으므로 기존 sigaction 핸들러(estop_fire())를 유지할 것.
+* loop_init()은 시그널 mask 를 설정하므로 스레드(watchdog, 축 스레드)를 만들기 전에 호출할 것.
+*********************************************************************************************************
+*/
+#define LOOP_MAX_SRC        8
+#define LOOP_MAX_EVENTS     (LOOP_MAX_SRC + 2)
+
+#define LOOP_CONF_PATH      "raspi_motor.conf"  // SIGHUP 시 다시 읽는 설정 파일
+
+typedef int (*loop_tick_fn)(void *arg);             // 반환 값 < 0 이면 loop 종료
+typedef int (*loop_src_fn)(int fd, void *arg);      // 반환 값 < 0 이면 source 제거
+typedef void (*loop_reload_fn)(void *arg);
+
+/*
+*********************************************************************************************************
+*                                              PREDEFINE FUNCTION
+*********************************************************************************************************
+*/
+int loop_init(void);
+int loop_set_tick(loop_tick_fn fn, void *arg);
+int loop_set_reload(loop_reload_fn fn, void *arg);
+int loop_add_source(int fd, loop_src_fn fn, void *arg);
+int loop_del_source(int fd);
+void loop_request_tick(void);
+int loop_run(void);
+void loop_stop(void);
+void loop_close(void);
+#endif
@@ -0,0 +1,271 @@
+/*
+*********************************************************************************************************
+*                                             ESTOP_C
+*********************************************************************************************************
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "motor_func.h"
+#include "rpi_func.h"
+#include "flight_rec.h"
+#include "estop.h"
+
+/*
+*********************************************************************************************************
+*                                      EMERGENCY STOP VARIABLE
+*********************************************************************************************************
+*/
+#define ESTOP_FRAME_LEN 3
+
+// estop_init()에서 미리 만들어 두는 출력 값
+static unsigned char    estop_frame_zero[ESTOP_FRAME_LEN];  // DAC_CMD_WRUP, DAC_ADDR_ALL, 0
+static unsigned char    estop_frame_pd[ESTOP_FRAME_LEN];    // DAC_CMD_POWER_DOWN_ALL
+static int              estop_dac_ch[2];
+static int              estop_dac_num = 0;
+static unsigned int     estop_brake_clr = 0;
+static unsigned int     estop_brake_set = 0;
+static volatile int     estop_ready = 0;
+
+static atomic_int       estop_latch;
+static atomic_uint      estop_count;
+static volatile int     estop_source = ESTOP_SRC_NONE;
+static volatile long    estop_brake_ns = 0;
+static volatile long    estop_dac_ns = 0;
+
+// watchdog
+static atomic_uint      estop_heartbeat;
+static atomic_int       estop_wdt_run;
+static int              estop_wdt_ms = ESTOP_WDT_MS;
+static pthread_t        estop_wdt_thread;
+
+static long estop_elapsed_ns(const struct timespec *from, const struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) * 1000000000L + (to->tv_nsec - from->tv_nsec);
+}
+
+/*
+* 미리 만들어 둔 프레임을 지역 버퍼에 복사해 전송 (rpi_spi_data_rw()는 rx 데이터로 버퍼를 덮어씀)
+*/
+static void estop_send(int channel, const unsigned char *frame)
+{
+    unsigned char buf[ESTOP_FRAME_LEN];
+    int i;
+
+    for(i=0; i<ESTOP_FRAME_LEN; i++) buf[i] = frame[i];
+    rpi_spi_data_rw(channel, buf, ESTOP_FRAME_LEN);
+}
+
+/*
+*********************************************************************************************************
+*                                      EMERGENCY STOP FUNC
+*********************************************************************************************************
+*/
+
+/*
+* 비상 정지 초기화 함수
+* int estop_init(void)
+* 입력 값 : 없음
+* 반환 값 : 성공 0 / 실패 -1
+* 설명 : gpio, spi 설정(및 motor_set_spi()) 이후에 호출할 것.
+*       DAC 0 출력/Power Down 프레임, 사용하는 DAC spi 채널 목록, 브레이크 GPIO mask 를 미리 만들어 둠.
+*/
+int estop_init(void)
+{
+    int l_ch = 0, r_ch = 0;
+
+    if( (PIN_MOTOR_BREAK_L > 31) | (PIN_MOTOR_BREAK_R > 31) ) return -1;
+
+    // C3~C0 A3~A0 / D9~D2 / D1 D0 XX... (writeDAC() 참조)
+    estop_frame_zero[0] = DAC_CMD_WRUP<<4 | DAC_ADDR_ALL;
+    estop_frame_zero[1] = 0;
+    estop_frame_zero[2] = 0;
+    estop_frame_pd[0]   = DAC_CMD_POWER_DOWN_ALL<<4 | DAC_ADDR_ALL;
+    estop_frame_pd[1]   = 0;
+    estop_frame_pd[2]   = 0;
+
+    motor_get_spi(LEFT_WHEEL, &l_ch, NULL);
+    motor_get_spi(RIGHT_WHEEL, &r_ch, NULL);
+    estop_dac_ch[0] = r_ch;
+    estop_dac_num   = 1;
+    if(l_ch != r_ch) estop_dac_ch[estop_dac_num++] = l_ch;
+
+    // BREAK_ON 상태의 핀 값에 따라 SET/CLEAR 레지스터 선택
+    if(BREAK_ON == ON)  estop_brake_set = (1u << PIN_MOTOR_BREAK_L) | (1u << PIN_MOTOR_BREAK_R);
+    else                estop_brake_clr = (1u << PIN_MOTOR_BREAK_L) | (1u << PIN_MOTOR_BREAK_R);
+
+    estop_ready = 1;
+    return 0;
+}
+
+/*
+* 비상 정지 함수
+* void estop_fire(int source)
+* 입력 값 : source ==> ESTOP_SRC_*
+* 반환 값 : 없음
+* 설명 : async-signal-safe. 어떤 context 에서도 호출 가능하며 여러번 호출해도 안전함.
+*       처음 호출될 때의 원인과 지연 시간만 기록됨.
+*/
+void estop_fire(int source)
+{
+    struct timespec t0, t1, t2;
+    int i, first;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    first = !atomic_exchange(&estop_latch, 1);
+    atomic_fetch_add(&estop_count, 1);
+    if(!estop_ready) return;
+
+    //1. 브레이크
+    if(rpi_gpio_write_mask(estop_brake_set, estop_brake_clr) == 0)
+        frec_note_gpio(FREC_GPIO_BREAK_L | FREC_GPIO_BREAK_R, 1);   // async-signal-safe
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    //2. DAC 0 출력, Power Down
+    for(i=0; i<estop_dac_num; i++)
+        estop_send(estop_dac_ch[i], estop_frame_zero);
+    for(i=0; i<estop_dac_num; i++)
+        estop_send(estop_dac_ch[i], estop_frame_pd);
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+
+    if(first){
+        estop_source    = source;
+        estop_brake_ns  = estop_elapsed_ns(&t0, &t1);
+        estop_dac_ns    = estop_elapsed_ns(&t0, &t2);
+    }
+}
+
+/*
+* 비상 정지 상태 확인/해제 함수
+* int estop_is_latched(void)   반환 값 : 정지 상태 1 / 정상 0
+* void estop_reset(void)       설명 : latch 해제. 브레이크와 DAC 는 사용자가 다시 설정할 것.
+*/
+int estop_is_latched(void)
+{
+    return atomic_load_explicit(&estop_latch, memory_order_acquire);
+}
+
+void estop_reset(void)
+{
+    estop_source    = ESTOP_SRC_NONE;
+    estop_brake_ns  = 0;
+    estop_dac_ns    = 0;
+    atomic_store(&estop_count, 0);
+    atomic_store(&estop_latch, 0);
+}
+
+/*
+* watchdog 갱신 함수 (writeDAC()에서 호출)
+* void estop_kick(void)
+*/
+void estop_kick(void)
+{
+    atomic_fetch_add_explicit(&estop_heartbeat, 1, memory_order_relaxed);
+}
+
+/*
+* watchdog 스레드
+* timeout_ms / 4 마다 heartbeat 를 확인하여 timeout_ms 동안 변화가 없으면 비상 정지.
+*/
+static void *estop_wdt_loop(void *arg)
+{
+    struct timespec period = {0,};
+    unsigned int last = 0, cur = 0;
+    int idle_ms = 0, step_ms = estop_wdt_ms / 4;
+
+    (void)arg;
+    if(step_ms < 1) step_ms = 1;
+    period.tv_sec   = step_ms / 1000;
+    period.tv_nsec  = (long)(step_ms % 1000) * 1000000L;
+
+    last = atomic_load(&estop_heartbeat);
+    while(atomic_load(&estop_wdt_run)){
+        nanosleep(&period, NULL);
+        cur = atomic_load(&estop_heartbeat);
+        if(cur != last){
+            last    = cur;
+            idle_ms = 0;
+        }
+        else if( ((idle_ms += step_ms) >= estop_wdt_ms) & !estop_is_latched() ){
+            estop_fire(ESTOP_SRC_WATCHDOG);
+        }
+    }
+    return NULL;
+}
+
+/*
+* watchdog 시작/종료 함수
+* int estop_watchdog_start(int timeout_ms)
+* 입력 값 : timeout_ms ==> 제어 출력이 멈춘 것으로 판단할 시간 (ESTOP_WDT_MS)
+* 반환 값 : 성공 0 / 실패 -1
+* void estop_watchdog_stop(void)
+*/
+int estop_watchdog_start(int timeout_ms)
+{
+    if(timeout_ms <= 0)                 return -1;
+    if(atomic_exchange(&estop_wdt_run, 1)) return -1;
+
+    estop_wdt_ms = timeout_ms;
+    if(pthread_create(&estop_wdt_thread, NULL, estop_wdt_loop, NULL) != 0){
+        atomic_store(&estop_wdt_run, 0);
+        printf("estop watchdog create error\n");
+        return -1;
+    }
+    return 0;
+}
+
+void estop_watchdog_stop(void)
+{
+    if(!atomic_exchange(&estop_wdt_run, 0)) return;
+    pthread_join(estop_wdt_thread, NULL);
+}
+
+/*
+* 비상 정지 기록 읽기 함수
+* void estop_get_stat(struct estop_stat *stat)
+*/
+void estop_get_stat(struct estop_stat *stat)
+{
+    if(stat == NULL) return;
+
+    stat->source    = estop_source;
+    stat->count     = atomic_load(&estop_count);
+    stat->brake_ns  = estop_brake_ns;
+    stat->dac_ns    = estop_dac_ns;
+}
+
+/*
+* 비상 정지 기록 출력 함수 (async-signal-safe, printf 미사용)
+* void estop_report(int fd)
+* 입력 값 : fd ==> 출력할 파일 디스크립터 (STDERR_FILENO 등)
+* 출력 예 : "ESTOP source 1 brake 1830 ns dac 152300 ns\n"
+*/
+void estop_report(int fd)
+{
+    char buf[96];
+    long val[3];
+    const char *label[3] = {"ESTOP source ", " brake ", " ns dac "};
+    int i, len = 0, n;
+    char num[24];
+    const char *p;
+
+    val[0] = estop_source;
+    val[1] = estop_brake_ns;
+    val[2] = estop_dac_ns;
+    for(i=0; i<3; i++){
+        for(p=label[i]; *p; p++) buf[len++] = *p;
+        if(val[i] < 0) val[i] = 0;
+        n = 0;
+        do{
+            num[n++] = '0' + (val[i] % 10);
+            val[i] /= 10;
+        }while(val[i] > 0);
+        while(n > 0) buf[len++] = num[--n];
+    }
+    for(p=" ns\n"; *p; p++) buf[len++] = *p;
+    if(write(fd, buf, len) < 0) return;
+}
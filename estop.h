@@ -0,0 +1,49 @@
+/*
+*********************************************************************************************************
+*                                              ESTOP.H
+*********************************************************************************************************
+*/
+#ifndef __ESTOP_H__
+#define __ESTOP_H__
+
+/*
+*********************************************************************************************************
+*                                         EMERGENCY STOP
+* 비상 정지시 출력할 DAC 프레임(0 출력, Power Down)과 브레이크 GPIO mask 를 estop_init()에서 미리 만들어 두고
+* estop_fire()에서는 MMIO 저장 1번(브레이크)과 spidev ioctl(DAC)만 수행함.
+* estop_fire()는 async-signal-safe 이므로 시그널 핸들러, watchdog 스레드, 제어 스레드 어디서든 호출 가능.
+*   1. 브레이크 ON (GPCLR0 에 1번 저장)  ==> 트리거 ~ 브레이크 시간 측정
+*   2. DAC 전 채널 0 출력 후 Power Down   ==> 트리거 ~ DAC 정지 시간 측정
+* 한번 동작하면 estop_reset() 전까지 latch 되며 writeDAC()는 출력을 거부함.
+* watchdog : writeDAC()가 ESTOP_WDT_MS 동안 호출되지 않으면(제어 루프 정지) 비상 정지.
+*********************************************************************************************************
+*/
+#define ESTOP_SRC_NONE      0
+#define ESTOP_SRC_SIGNAL    1   // 시그널 핸들러 (SIGINT, SIGTERM, SIGSEGV ...)
+#define ESTOP_SRC_WATCHDOG  2   // 제어 루프 watchdog
+#define ESTOP_SRC_CONTROL   3   // 제어 스레드 (오류 처리, 정상 종료)
+
+#define ESTOP_WDT_MS        50  // watchdog 기본 시간 (ms)
+
+struct estop_stat {
+    int             source;     // 처음 동작한 원인 ESTOP_SRC_*
+    unsigned int    count;      // estop_fire() 호출 횟수
+    long            brake_ns;   // 트리거 ~ 브레이크 ON (ns)
+    long            dac_ns;     // 트리거 ~ DAC 0 출력 및 Power Down 완료 (ns)
+};
+
+/*
+*********************************************************************************************************
+*                                              PREDEFINE FUNCTION
+*********************************************************************************************************
+*/
+int estop_init(void);
+void estop_fire(int source);
+int estop_is_latched(void);
+void estop_reset(void);
+void estop_kick(void);
+int estop_watchdog_start(int timeout_ms);
+void estop_watchdog_stop(void);
+void estop_get_stat(struct estop_stat *stat);
+void estop_report(int fd);
+#endif
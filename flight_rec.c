@@ -0,0 +1,160 @@
+/*
+*********************************************************************************************************
+*                                             FLIGHT_REC_C
+*********************************************************************************************************
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "motor_func.h"
+#include "flight_rec.h"
+
+/*
+*********************************************************************************************************
+*                                      FLIGHT RECORDER VARIABLE
+*********************************************************************************************************
+*/
+static struct frec_header   *frec_hdr = NULL;
+static struct frec_record   *frec_rec = NULL;
+static size_t               frec_size = 0;
+
+// 다음 commit 에 함께 기록될 하드웨어 상태 (각 hook 에서 갱신)
+static volatile unsigned char   frec_enc_raw[2][3];
+static volatile unsigned short  frec_enc_pos[2];
+static volatile unsigned short  frec_dac[2];
+static volatile unsigned char   frec_gpio = 0;
+
+/*
+* 기록 파일 열기 함수
+* int frec_open(const char *path, uint32_t capacity)
+* 입력 값 : path ==> 기록 파일 경로 (FREC_PATH)
+*         capacity ==> 레코드 수 (FREC_CAPACITY)
+* 반환 값 : 성공 0 / 실패 -1
+* 설명 : 이전 기록이 있으면 <path>.prev 로 이름을 바꾸고 새 파일을 만들어 mmap 함.
+*       열지 않은 상태에서는 모든 frec_* hook 이 아무 동작도 하지 않음.
+*/
+int frec_open(const char *path, uint32_t capacity)
+{
+    struct timespec ts;
+    char prev[256];
+    int fd;
+    void *map;
+
+    if( (path == NULL) | (capacity == 0) )  return -1;
+    if(frec_hdr != NULL)                    return -1;
+
+    snprintf(prev, sizeof(prev), "%s.prev", path);
+    rename(path, prev);
+
+    if((fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0){
+        printf("frec open error\n");
+        return -1;
+    }
+    frec_size = sizeof(struct frec_header) + (size_t)capacity * sizeof(struct frec_record);
+    if(ftruncate(fd, frec_size) < 0){
+        printf("frec ftruncate error\n");
+        close(fd);
+        return -1;
+    }
+    map = mmap(0, frec_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED){
+        printf("frec mmap error\n");
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    frec_rec = (struct frec_record *)((char *)map + sizeof(struct frec_header));
+    frec_hdr = (struct frec_header *)map;
+    memcpy(frec_hdr->magic, FREC_MAGIC, sizeof(frec_hdr->magic));
+    frec_hdr->version   = FREC_VERSION;
+    frec_hdr->rec_size  = sizeof(struct frec_record);
+    frec_hdr->capacity  = capacity;
+    frec_hdr->tick_hz   = (uint32_t)(1 / dT);
+    frec_hdr->start_ns  = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    frec_hdr->head      = 0;
+    return 0;
+}
+
+/*
+* 기록 파일 닫기 함수
+* void frec_close(void)
+*/
+void frec_close(void)
+{
+    if(frec_hdr == NULL) return;
+
+    munmap(frec_hdr, frec_size);
+    frec_hdr = NULL;
+    frec_rec = NULL;
+}
+
+/*
+* 하드웨어 상태 hook (encoder_read(), writeDAC(), brake_wheel(), set_direction()에서 호출)
+* 다음 frec_commit() 레코드에 기록될 값을 갱신함.
+*/
+void frec_note_encoder(int wheel_direction, const unsigned char *raw, unsigned short pos)
+{
+    if( (wheel_direction != LEFT_WHEEL) & (wheel_direction != RIGHT_WHEEL) ) return;
+
+    frec_enc_raw[wheel_direction][0] = raw[0];
+    frec_enc_raw[wheel_direction][1] = raw[1];
+    frec_enc_raw[wheel_direction][2] = raw[2];
+    frec_enc_pos[wheel_direction]    = pos;
+}
+
+void frec_note_dac(unsigned char addr, unsigned short data)
+{
+    if(addr != DAC_ADDR_LEFT)   frec_dac[RIGHT_WHEEL]   = data;
+    if(addr != DAC_ADDR_RIGHT)  frec_dac[LEFT_WHEEL]    = data;
+}
+
+void frec_note_gpio(unsigned char bit, int value)
+{
+    if(value)   __atomic_or_fetch(&frec_gpio, bit, __ATOMIC_RELAXED);
+    else        __atomic_and_fetch(&frec_gpio, (unsigned char)~bit, __ATOMIC_RELAXED);
+}
+
+/*
+* 1 tick 레코드 기록 함수
+* void frec_commit(int wheel_direction, int type, float pos, float err, float err_i)
+* 입력 값 : wheel_direction ==> LEFT_WHEEL / RIGHT_WHEEL
+*         type ==> FREC_TYPE_*
+*         pos, err, err_i ==> 제어기 피드백, 오차, 적분 오차
+* 반환 값 : 없음
+* 설명 : 여러 스레드(axis_rt.c)에서 동시에 호출 가능. 레코드 번호는 원자적으로 할당.
+*/
+void frec_commit(int wheel_direction, int type, float pos, float err, float err_i)
+{
+    struct frec_record *r;
+    struct timespec ts;
+    uint64_t idx;
+
+    if(frec_hdr == NULL) return;
+    if( (wheel_direction != LEFT_WHEEL) & (wheel_direction != RIGHT_WHEEL) ) return;
+
+    idx = __atomic_fetch_add(&frec_hdr->head, 1, __ATOMIC_RELAXED);
+    r   = &frec_rec[idx % frec_hdr->capacity];
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    __atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    r->t_us         = (uint32_t)(((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec - frec_hdr->start_ns) / 1000);
+    r->wheel        = wheel_direction;
+    r->gpio         = frec_gpio;
+    r->dac_word     = frec_dac[wheel_direction];
+    r->enc_raw[0]   = frec_enc_raw[wheel_direction][0];
+    r->enc_raw[1]   = frec_enc_raw[wheel_direction][1];
+    r->enc_raw[2]   = frec_enc_raw[wheel_direction][2];
+    r->flags        = type;
+    r->enc_pos      = frec_enc_pos[wheel_direction];
+    r->pos          = pos;
+    r->err          = err;
+    r->err_i        = err_i;
+    __atomic_store_n(&r->seq, (uint32_t)(idx + 1), __ATOMIC_RELEASE);
+}
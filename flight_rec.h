@@ -0,0 +1,80 @@
+/*
+*********************************************************************************************************
+*                                              FLIGHT_REC.H
+*********************************************************************************************************
+*/
+#ifndef __FLIGHT_REC_H__
+#define __FLIGHT_REC_H__
+
+#include <stdint.h>
+
+/*
+*********************************************************************************************************
+*                                  CRASH-SURVIVING FLIGHT RECORDER
+* 제어 tick 마다 제어 상태를 고정 크기 링 파일(mmap, MAP_SHARED)에 기록함.
+* 기록은 메모리 저장 몇 번 뿐이고 시스템 콜을 사용하지 않음 (시간은 vDSO clock_gettime).
+* 프로세스가 SIGINT/abort()/segfault 로 종료되어도 기록은 커널 페이지 캐시에 남아 있으므로
+* frec_dump.out 으로 마지막 N초를 복원할 수 있음. (전원 차단시에는 보장되지 않음)
+* 이전 실행의 기록 파일은 frec_open()시 <path>.prev 로 보존됨.
+*
+* 각 레코드는 seq 를 0 으로 만든 후 내용을 쓰고 마지막에 seq 를 기록하므로
+* 기록 도중 종료된 레코드는 seq == 0 으로 남아 디코더가 무시함.
+*********************************************************************************************************
+*/
+#define FREC_MAGIC          "RMFREC1"
+#define FREC_VERSION        1
+#define FREC_PATH           "raspi_motor.frec"
+#define FREC_CAPACITY       20000   // 레코드 수 (1kHz, 바퀴 2개 기준 약 10초)
+
+// gpio 필드 비트 (브레이크 동작 중 / 방향 FORWARD 이면 1)
+#define FREC_GPIO_BREAK_L   0x01
+#define FREC_GPIO_BREAK_R   0x02
+#define FREC_GPIO_DIR_L     0x04
+#define FREC_GPIO_DIR_R     0x08
+
+// 레코드 종류 (flags 필드)
+#define FREC_TYPE_POS       0x01    // pos_control()
+#define FREC_TYPE_VEL       0x02    // vel_control()
+#define FREC_TYPE_SYNC      0x03    // sync_control()
+
+// 파일 헤더 (파일 앞 64byte)
+struct frec_header {
+    char                magic[8];
+    uint32_t            version;
+    uint32_t            rec_size;
+    uint32_t            capacity;
+    uint32_t            tick_hz;
+    volatile uint64_t   head;           // 다음에 기록할 레코드 번호
+    uint64_t            start_ns;       // 기록 시작 시각 (CLOCK_MONOTONIC)
+    uint8_t             reserved[24];
+};
+
+// 1 tick 레코드 (32byte)
+struct frec_record {
+    volatile uint32_t   seq;            // 레코드 번호 + 1 (0 이면 빈/미완성 레코드). 2kHz 에서 약 24일마다 wrap,
+                                        // 디코더는 header head 기준 차이로 정렬하고 64bit 번호로 복원 (wrap 시점 1개는 0 이 되어 무시됨)
+    uint32_t            t_us;           // start_ns 기준 시각 (us, 약 71.6분마다 wrap. 비교는 부호 있는 차이로 할 것)
+    uint8_t             wheel;          // LEFT_WHEEL / RIGHT_WHEEL
+    uint8_t             gpio;           // FREC_GPIO_* (브레이크, 방향 상태)
+    uint16_t            dac_word;       // 해당 바퀴에 마지막으로 쓴 DAC word
+    uint8_t             enc_raw[3];     // 엔코더 SPI 원본 프레임
+    uint8_t             flags;          // FREC_TYPE_*
+    uint16_t            enc_pos;        // 디코딩된 엔코더 값
+    uint16_t            reserved;
+    float               pos;            // 피드백 (degree 또는 degree/sec)
+    float               err;            // 제어 오차
+    float               err_i;          // 적분 오차
+};
+
+/*
+*********************************************************************************************************
+*                                              PREDEFINE FUNCTION
+*********************************************************************************************************
+*/
+int frec_open(const char *path, uint32_t capacity);
+void frec_close(void);
+void frec_note_encoder(int wheel_direction, const unsigned char *raw, unsigned short pos);
+void frec_note_dac(unsigned char addr, unsigned short data);
+void frec_note_gpio(unsigned char bit, int value);
+void frec_commit(int wheel_direction, int type, float pos, float err, float err_i);
+#endif
@@ -0,0 +1,96 @@
+/*
+*********************************************************************************************************
+*                                             FREC_DUMP_C
+* flight recorder(flight_rec.c) 기록 파일 디코더.
+* (raspberry pi3) $ ./frec_dump.out raspi_motor.frec 2
+*   > 마지막 2초의 제어 기록을 CSV로 출력 (초를 생략하면 전체)
+* (raspberry pi3) $ ./frec_dump.out raspi_motor.frec.prev
+*   > 직전 실행의 기록 출력
+*********************************************************************************************************
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include "flight_rec.h"
+
+// 링에 남아 있을 수 있는 가장 오래된 레코드의 seq (head - capacity + 1, uint32_t 로 wrap)
+static uint32_t frec_seq_base = 1;
+
+/*
+* seq 는 uint32_t 로 wrap 되므로 가장 오래된 레코드 기준 차이로 정렬
+*/
+static int frec_cmp_seq(const void *a, const void *b)
+{
+    uint32_t ka = ((const struct frec_record *)a)->seq - frec_seq_base;
+    uint32_t kb = ((const struct frec_record *)b)->seq - frec_seq_base;
+
+    return (ka > kb) - (ka < kb);
+}
+
+int main(int argc, char **argv)
+{
+    struct frec_header hdr;
+    struct frec_record *rec, *r;
+    FILE *fp;
+    double seconds = -1;
+    uint32_t i, n = 0, t_end = 0;
+    uint64_t base = 0;
+    int32_t dt;
+
+    if(argc < 2){
+        printf("usage : %s <frec file> [seconds]\n", argv[0]);
+        return 1;
+    }
+    if(argc > 2) seconds = atof(argv[2]);
+
+    if((fp = fopen(argv[1], "rb")) == NULL){
+        perror(argv[1]);
+        return 1;
+    }
+    if( (fread(&hdr, sizeof(hdr), 1, fp) != 1) | (memcmp(hdr.magic, FREC_MAGIC, sizeof(hdr.magic)) != 0) ){
+        printf("%s : not a flight recorder file\n", argv[1]);
+        return 1;
+    }
+    if( (hdr.version != FREC_VERSION) | (hdr.rec_size != sizeof(struct frec_record)) ){
+        printf("%s : unsupported version %u (record size %u)\n", argv[1], hdr.version, hdr.rec_size);
+        return 1;
+    }
+
+    if((rec = malloc((size_t)hdr.capacity * sizeof(struct frec_record))) == NULL){
+        printf("malloc error\n");
+        return 1;
+    }
+    //완성된 레코드(seq != 0)만 모아 순서대로 정렬
+    for(i=0; i<hdr.capacity; i++){
+        if(fread(&rec[n], sizeof(struct frec_record), 1, fp) != 1) break;
+        if(rec[n].seq != 0) n++;
+    }
+    fclose(fp);
+    if(hdr.head > hdr.capacity) base = hdr.head - hdr.capacity;
+    frec_seq_base = (uint32_t)(base + 1);
+    qsort(rec, n, sizeof(struct frec_record), frec_cmp_seq);
+
+    printf("# %s : %u records (capacity %u, head %llu, %u Hz)\n", argv[1], n, hdr.capacity,\
+                                                                   (unsigned long long)hdr.head, hdr.tick_hz);
+    if(n == 0) return 0;
+
+    //t_us 는 uint32_t 로 wrap 되므로 마지막 레코드 기준 부호 있는 차이(int32_t)로 비교
+    t_end = rec[n-1].t_us;
+
+    printf("seq,t_ms,wheel,type,enc_raw,enc_pos,pos,err,err_i,dac_word,break_l,break_r,dir_l,dir_r\n");
+    for(i=0; i<n; i++){
+        r = &rec[i];
+        dt = (int32_t)(r->t_us - t_end);
+        if( (seconds >= 0) && (dt < -(double)seconds * 1000000) ) continue;
+        printf("%llu,%.3f,%s,%s,%02x%02x%02x,0x%03x,%.3f,%.3f,%.4f,0x%03x,%d,%d,%d,%d\n",
+               (unsigned long long)(base + 1 + (uint32_t)(r->seq - frec_seq_base)), (double)dt / 1000, r->wheel ? "L" : "R",
+               (r->flags == FREC_TYPE_POS) ? "pos" : (r->flags == FREC_TYPE_VEL) ? "vel" : (r->flags == FREC_TYPE_SYNC) ? "sync" : "?",
+               r->enc_raw[0], r->enc_raw[1], r->enc_raw[2], r->enc_pos, r->pos, r->err, r->err_i, r->dac_word,
+               !!(r->gpio & FREC_GPIO_BREAK_L), !!(r->gpio & FREC_GPIO_BREAK_R),
+               !!(r->gpio & FREC_GPIO_DIR_L), !!(r->gpio & FREC_GPIO_DIR_R));
+    }
+    free(rec);
+    return 0;
+}
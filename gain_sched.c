@@ -0,0 +1,194 @@
+/*
+*********************************************************************************************************
+*                                             GAIN_SCHED_C
+*********************************************************************************************************
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "motor_func.h"
+#include "gain_sched.h"
+
+/*
+*********************************************************************************************************
+*                                        PI GAIN SCHEDULING VARIABLE
+*********************************************************************************************************
+*/
+
+// [ctrl][wheel] 제어기(GS_CTRL_POS 0 / GS_CTRL_VEL 1), 바퀴(RIGHT_WHEEL 0 / LEFT_WHEEL 1) 별 테이블
+// scale 은 gs_set()에서 미리 계산 (값 * scale = 테이블 인덱스)
+static struct gs_slot {
+    struct gain_table   t;
+    float               vel_scale;
+    float               ax2_scale;
+} gs_tbl[2][2];
+static int gs_on = 0;
+
+/*
+* 게인 테이블 초기화 함수
+* void gs_init(void)
+* 입력 값 : 없음
+* 반환 값 : 없음
+* 설명 : 모든 테이블을 Kp, Ki 로 채우고(기존 동작과 동일) gain scheduling 을 활성화.
+*       실제 테이블은 gs_set()으로 덮어씀.
+*/
+void gs_init(void)
+{
+    struct gain_table t;
+    int c, w;
+
+    gs_table_init(&t, GS_AXIS_NONE, GS_VEL_MAX_DEFAULT, 0);
+    for(c=0; c<2; c++)
+        for(w=0; w<2; w++)
+            gs_set(w, c, &t);
+    gs_on = 1;
+}
+
+/*
+* gain scheduling 활성화/비활성화
+* void gs_enable(int on)
+* 입력 값 : on ==> ON(1) / OFF(0)
+* 반환 값 : 없음
+* 설명 : 비활성화시 gs_lookup()은 Kp, Ki 를 반환함.
+*/
+void gs_enable(int on)
+{
+    gs_on = on ? 1 : 0;
+}
+
+/*
+* 테이블 작성 도우미
+* void gs_table_init(struct gain_table *t, int axis2, float vel_max, float ax2_max)
+* 입력 값 : t ==> 초기화할 테이블
+*         axis2 ==> GS_AXIS_*
+*         vel_max, ax2_max ==> 각 축의 범위
+* 반환 값 : 없음
+* 설명 : 모든 점을 Kp, Ki 로 채움. 이후 필요한 점만 t->g[][] 에 직접 설정.
+*/
+void gs_table_init(struct gain_table *t, int axis2, float vel_max, float ax2_max)
+{
+    int x, y;
+
+    if(t == NULL) return;
+
+    t->axis2    = axis2;
+    t->vel_max  = vel_max;
+    t->ax2_max  = ax2_max;
+    for(y=0; y<GS_AX2_N; y++){
+        for(x=0; x<GS_VEL_N; x++){
+            t->g[y][x].kp = Kp;
+            t->g[y][x].ki = Ki;
+        }
+    }
+}
+
+/*
+* 게인 테이블 설정/읽기 함수
+* int gs_set(int wheel_direction, int ctrl, const struct gain_table *t)
+* int gs_get(int wheel_direction, int ctrl, struct gain_table *t)
+* 입력 값 : wheel_direction ==> LEFT_WHEEL / RIGHT_WHEEL
+*         ctrl ==> GS_CTRL_POS / GS_CTRL_VEL
+*         t ==> 설정할(읽어올) 테이블
+* 반환 값 : 성공 0 / 실패 -1
+* 설명 : 제어 스레드에서 사용 중인 테이블을 바꿀 경우 제어 tick 사이에 호출할 것.
+*/
+int gs_set(int wheel_direction, int ctrl, const struct gain_table *t)
+{
+    struct gs_slot *s;
+
+    if( (wheel_direction != LEFT_WHEEL) & (wheel_direction != RIGHT_WHEEL) )    return -1;
+    if( (ctrl != GS_CTRL_POS) & (ctrl != GS_CTRL_VEL) )                        return -1;
+    if( (t == NULL) || (t->vel_max <= 0) )                                      return -1;
+    if( (t->axis2 != GS_AXIS_NONE) && (t->ax2_max <= 0) )                       return -1;
+
+    s = &gs_tbl[ctrl][wheel_direction];
+    s->t            = *t;
+    s->vel_scale    = (GS_VEL_N - 1) / t->vel_max;
+    s->ax2_scale    = (t->axis2 == GS_AXIS_NONE) ? 0 : (GS_AX2_N - 1) / t->ax2_max;
+    return 0;
+}
+
+int gs_get(int wheel_direction, int ctrl, struct gain_table *t)
+{
+    if( (wheel_direction != LEFT_WHEEL) & (wheel_direction != RIGHT_WHEEL) )    return -1;
+    if( (ctrl != GS_CTRL_POS) & (ctrl != GS_CTRL_VEL) )                        return -1;
+    if(t == NULL)                                                               return -1;
+
+    *t = gs_tbl[ctrl][wheel_direction].t;
+    return 0;
+}
+
+/*
+* 게인 보간 함수 (매 제어 tick 호출)
+* int gs_lookup(int wheel_direction, int ctrl, float vel, float err, float dac, struct gs_gain *gain)
+* 입력 값 : wheel_direction ==> LEFT_WHEEL / RIGHT_WHEEL
+*         ctrl ==> GS_CTRL_POS / GS_CTRL_VEL
+*         vel ==> 측정 속도 (degree/sec, 부호 무시)
+*         err ==> 제어 오차 (GS_AXIS_ERR 일 때 사용, 부호 무시)
+*         dac ==> 직전 DAC word (GS_AXIS_DAC 일 때 사용)
+*         gain ==> 보간된 게인
+* 반환 값 : 테이블 사용 0 / 비활성화 또는 잘못된 인자로 Kp, Ki 반환 -1
+* 설명 : 범위를 넘는 값은 마지막 점으로 고정. 인덱스 계산과 범위 제한은 분기 없이 수행.
+*/
+int gs_lookup(int wheel_direction, int ctrl, float vel, float err, float dac, struct gs_gain *gain)
+{
+    const struct gs_slot *s;
+    const struct gs_gain *g0, *g1;
+    float x, y, fx, fy, a2;
+    int ix, iy;
+
+    gain->kp = Kp;
+    gain->ki = Ki;
+    if( (!gs_on) | ((wheel_direction != LEFT_WHEEL) & (wheel_direction != RIGHT_WHEEL)) )  return -1;
+    if( (ctrl != GS_CTRL_POS) & (ctrl != GS_CTRL_VEL) )                                 return -1;
+
+    s  = &gs_tbl[ctrl][wheel_direction];
+    a2 = (s->t.axis2 == GS_AXIS_DAC) ? dac : err;
+
+    //축 값 --> 실수 인덱스 (0 ~ N-1 로 제한)
+    x  = fminf(fabsf(vel) * s->vel_scale, GS_VEL_N - 1);
+    y  = fminf(fabsf(a2) * s->ax2_scale, GS_AX2_N - 1);
+    ix = (int)x;
+    iy = (int)y;
+    ix -= (ix == GS_VEL_N - 1);     // 마지막 점에서는 왼쪽 구간의 끝(fx = 1)으로 처리
+    iy -= (iy == GS_AX2_N - 1);
+    fx = x - ix;
+    fy = y - iy;
+
+    //bilinear 보간 (인접한 두 행의 연속된 두 점)
+    g0 = &s->t.g[iy][ix];
+    g1 = &s->t.g[iy + 1][ix];
+    gain->kp = (1 - fy) * (g0[0].kp + (g0[1].kp - g0[0].kp) * fx) + fy * (g1[0].kp + (g1[1].kp - g1[0].kp) * fx);
+    gain->ki = (1 - fy) * (g0[0].ki + (g0[1].ki - g0[0].ki) * fx) + fy * (g1[0].ki + (g1[1].ki - g1[0].ki) * fx);
+    return 0;
+}
+
+/*
+* bumpless transfer 함수
+* float gs_bumpless(float err_i, float err, struct gs_gain *ref, const struct gs_gain *cur)
+* 입력 값 : err_i ==> 현재 적분 오차 (이번 tick 적분 전)
+*         err ==> 이번 tick 오차
+*         ref ==> 마지막으로 보정한 시점의 게인 (보정하면 cur 로 갱신됨, 처음에는 기본 게인)
+*         cur ==> 이번 tick 게인
+* 반환 값 : 보정된 적분 오차
+* 설명 : cur->kp * err + cur->ki * err_i' == ref->kp * err + ref->ki * err_i 가 되도록 err_i 를 보정하여
+*       게인이 바뀌어도 제어 출력이 연속이 되게 함. 위치형 PI(pos_control(), sync_control())에서만 사용.
+*       (누적형인 vel_control()은 출력에 증분만 더하므로 게인이 바뀌어도 출력이 튀지 않음)
+*       게인은 보간으로 매 tick 조금씩 바뀌므로 직전 tick 이 아닌 ref 와 비교하여, Kp, Ki 중 하나라도
+*       GS_BUMP_REL 보다 크게 바뀌면 보정함 (천천히 바뀌어도 누적 변화가 GS_BUMP_REL 을 넘으면 보정).
+*       cur->ki 가 GS_KI_MIN 보다 작으면 그대로 반환.
+*       보정된 값은 적분 항(cur->ki * err_i')이 DAC_DATA_MAX 를 넘지 않도록 제한.
+*/
+float gs_bumpless(float err_i, float err, struct gs_gain *ref, const struct gs_gain *cur)
+{
+    float lim;
+
+    if(cur->ki < GS_KI_MIN)                                         return err_i;
+    if( (fabsf(cur->kp - ref->kp) <= GS_BUMP_REL * fabsf(ref->kp)) &
+        (fabsf(cur->ki - ref->ki) <= GS_BUMP_REL * fabsf(ref->ki)) )   return err_i;
+
+    err_i   = ((ref->kp - cur->kp) * err + ref->ki * err_i) / cur->ki;
+    lim     = DAC_DATA_MAX / cur->ki;
+    *ref    = *cur;
+    return fmaxf(-lim, fminf(err_i, lim));
+}
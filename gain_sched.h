@@ -0,0 +1,59 @@
+/*
+*********************************************************************************************************
+*                                              GAIN_SCHED.H
+*********************************************************************************************************
+*/
+#ifndef __GAIN_SCHED_H__
+#define __GAIN_SCHED_H__
+
+/*
+*********************************************************************************************************
+*                                          PI GAIN SCHEDULING
+* 고정된 Kp, Ki 대신 바퀴/제어기 별 테이블에서 매 tick 게인을 보간하여 사용.
+* 1번 축 : 측정 속도 |vel| (degree/sec), 0 ~ vel_max 를 GS_VEL_N 점으로 균등 분할
+* 2번 축 : 선택 (GS_AXIS_NONE / GS_AXIS_ERR 오차 크기 / GS_AXIS_DAC 직전 DAC word), 0 ~ ax2_max 를 GS_AX2_N 점으로 균등 분할
+* 균등 간격이므로 탐색 없이 곱셈 1번으로 인덱스를 구하고 인접 4점을 bilinear 보간함.
+* 테이블 1개는 256 byte 로 캐시 라인 4개에 들어감.
+* 위치형 PI 는 게인이 크게 바뀌는 tick 에 gs_bumpless()로 적분 상태를 보정하여 제어 출력이 튀지 않게 함.
+*********************************************************************************************************
+*/
+#define GS_VEL_N            8       // 속도 축 점 수
+#define GS_AX2_N            4       // 2번 축 점 수
+#define GS_VEL_MAX_DEFAULT  720.0   // 속도 축 기본 범위 (degree/sec)
+#define GS_KI_MIN           1e-4    // 이보다 작은 Ki 로는 적분 상태를 보정하지 않음
+#define GS_BUMP_REL         0.05    // Kp, Ki 중 하나라도 마지막 보정 시점보다 이 비율 넘게 바뀌면 적분 상태 보정
+
+// 제어기
+#define GS_CTRL_POS         0       // pos_control(), sync_control()
+#define GS_CTRL_VEL         1       // vel_control()
+
+// 2번 축 종류
+#define GS_AXIS_NONE        0
+#define GS_AXIS_ERR         1
+#define GS_AXIS_DAC         2
+
+struct gs_gain {
+    float   kp;
+    float   ki;
+};
+
+struct gain_table {
+    int             axis2;                      // GS_AXIS_*
+    float           vel_max;                    // 속도 축 범위 (degree/sec)
+    float           ax2_max;                    // 2번 축 범위 (오차 단위 또는 DAC word)
+    struct gs_gain  g[GS_AX2_N][GS_VEL_N];      // [2번 축][속도 축]
+};
+
+/*
+*********************************************************************************************************
+*                                              PREDEFINE FUNCTION
+*********************************************************************************************************
+*/
+void gs_init(void);
+void gs_enable(int on);
+void gs_table_init(struct gain_table *t, int axis2, float vel_max, float ax2_max);
+int gs_set(int wheel_direction, int ctrl, const struct gain_table *t);
+int gs_get(int wheel_direction, int ctrl, struct gain_table *t);
+int gs_lookup(int wheel_direction, int ctrl, float vel, float err, float dac, struct gs_gain *gain);
+float gs_bumpless(float err_i, float err, struct gs_gain *ref, const struct gs_gain *cur);
+#endif
@@ -0,0 +1,273 @@
+/*
+*********************************************************************************************************
+*                                             MOTOR_COMP_C
+*********************************************************************************************************
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include "motor_func.h"
+#include "motor_comp.h"
+
+/*
+*********************************************************************************************************
+*                                  DAC DEAD-ZONE / FRICTION COMPENSATION VARIABLE
+*********************************************************************************************************
+*/
+
+// [wheel][direction] 바퀴(RIGHT_WHEEL 0 / LEFT_WHEEL 1), 방향(BACKWARD 0 / FORWARD 1) 별 보상 값
+static struct motor_comp comp_tbl[2][2];
+static int comp_on = 0;
+
+/*
+* 보상 테이블 초기화 함수
+* void comp_init(void)
+* 입력 값 : 없음
+* 반환 값 : 없음
+* 설명 : 모든 바퀴/방향에 대해 실험값(COMP_DEADZONE_DEFAULT)으로 초기화하고 보상을 활성화.
+*       정확한 값은 comp_identify()로 측정하여 덮어씀.
+*/
+void comp_init(void)
+{
+    int w, d;
+
+    for(w=0; w<2; w++){
+        for(d=0; d<2; d++){
+            comp_tbl[w][d].breakaway    = COMP_DEADZONE_DEFAULT;
+            comp_tbl[w][d].coulomb      = COMP_DEADZONE_DEFAULT;
+            comp_tbl[w][d].viscous      = 0;
+            comp_tbl[w][d].lut_valid    = 0;
+        }
+    }
+    comp_on = 1;
+}
+
+/*
+* 보상 활성화/비활성화
+* void comp_enable(int on)
+* 입력 값 : on ==> ON(1) / OFF(0)
+* 반환 값 : 없음
+* 설명 : 비활성화시 comp_output()은 제어 입력을 DAC 범위로 자르기만 함(기존 동작).
+*/
+void comp_enable(int on)
+{
+    comp_on = on ? 1 : 0;
+}
+
+/*
+* 보상 값 설정/읽기 함수
+* int comp_set(int wheel_direction, int move_direction, const struct motor_comp *comp)
+* int comp_get(int wheel_direction, int move_direction, struct motor_comp *comp)
+* 입력 값 : wheel_direction ==> LEFT_WHEEL / RIGHT_WHEEL
+*         move_direction ==> FORWARD / BACKWARD
+*         comp ==> 설정할(읽어올) 보상 값
+* 반환 값 : 성공 0 / 실패 -1
+*/
+int comp_set(int wheel_direction, int move_direction, const struct motor_comp *comp)
+{
+    if( (wheel_direction != LEFT_WHEEL) & (wheel_direction != RIGHT_WHEEL) )    return -1;
+    if( (move_direction != FORWARD) & (move_direction != BACKWARD) )            return -1;
+    if(comp == NULL)                                                            return -1;
+
+    comp_tbl[wheel_direction][move_direction] = *comp;
+    return 0;
+}
+
+int comp_get(int wheel_direction, int move_direction, struct motor_comp *comp)
+{
+    if( (wheel_direction != LEFT_WHEEL) & (wheel_direction != RIGHT_WHEEL) )    return -1;
+    if( (move_direction != FORWARD) & (move_direction != BACKWARD) )            return -1;
+    if(comp == NULL)                                                            return -1;
+
+    *comp = comp_tbl[wheel_direction][move_direction];
+    return 0;
+}
+
+/*
+* 제어 입력 선형화 함수
+* unsigned short comp_output(int wheel_direction, int move_direction, float u, float vel)
+* 입력 값 : wheel_direction ==> LEFT_WHEEL / RIGHT_WHEEL
+*         move_direction ==> FORWARD / BACKWARD (현재 설정된 모터 방향)
+*         u ==> PI 제어기 출력 (부호는 무시, 크기만 사용)
+*         vel ==> 현재 측정 속도 (degree/sec, move_direction 기준 부호. 설정된 방향으로 회전하면 +)
+* 반환 값 : writeDAC()로 보낼 DAC word
+* 설명 : 정지 상태에서는 breakaway, 이동 중에는 coulomb + COMP_VISCOUS_FRAC * viscous * vel 만큼 더해 데드존을 건너뜀.
+*       COMP_VEL_STILL ~ COMP_VEL_MOVE 구간은 두 값을 속도에 비례하여 섞음.
+*       방향 전환 중이거나 외력으로 반대 방향으로 회전 중(vel < 0)이면 이동 상태 보상을 쓰지 않고 정지 상태(breakaway)로 봄.
+*       측정된 LUT가 있으면 LUT를 선형 보간하여 사용.
+*/
+unsigned short comp_output(int wheel_direction, int move_direction, float u, float vel)
+{
+    struct motor_comp *c;
+    float word = 0, pos = 0, still = 0, move = 0, a = 0;
+    int idx = 0;
+
+    if(u < 0)   u = -u;
+
+    if( (!comp_on) | ((wheel_direction != LEFT_WHEEL) & (wheel_direction != RIGHT_WHEEL)) ){
+        word = u;
+    }
+    else if(u < COMP_U_DEADBAND){
+        word = DAC_DATA_MIN;
+    }
+    else{
+        c = &comp_tbl[wheel_direction][(move_direction == FORWARD) ? FORWARD : BACKWARD];
+
+        //정지(0) ~ 이동(1) 비율 (반대 방향 회전은 0)
+        a = (vel - COMP_VEL_STILL) / (COMP_VEL_MOVE - COMP_VEL_STILL);
+        if(a < 0) a = 0;
+        if(a > 1) a = 1;
+
+        if(c->lut_valid){
+            pos = u * (COMP_LUT_SIZE - 1) / DAC_DATA_MAX;
+            idx = (int)pos;
+            if(idx >= COMP_LUT_SIZE - 1)
+                word = c->lut[COMP_LUT_SIZE - 1];
+            else
+                word = c->lut[idx] + ((float)c->lut[idx+1] - c->lut[idx]) * (pos - idx);
+            if(word < c->breakaway)
+                word += (c->breakaway - word) * (1 - a);
+        }
+        else{
+            still   = c->breakaway + u;
+            move    = c->coulomb + COMP_VISCOUS_FRAC * c->viscous * vel + u;
+            word    = still + (move - still) * a;
+        }
+    }
+
+    //임계값 처리
+    if(word > DAC_DATA_MAX) word = DAC_DATA_MAX;
+    if(word < DAC_DATA_MIN) word = DAC_DATA_MIN;
+
+    return (unsigned short)word;
+}
+
+/*
+*********************************************************************************************************
+*                                  DAC DEAD-ZONE / FRICTION IDENTIFICATION
+*********************************************************************************************************
+*/
+
+/*
+* 일정 DAC word를 ms 동안 출력하면서 엔코더 변화량(절대값)의 합을 반환.
+*/
+static int comp_id_counts(int wheel_direction, unsigned short word, int ms)
+{
+    unsigned char addr = (wheel_direction == LEFT_WHEEL) ? DAC_ADDR_LEFT : DAC_ADDR_RIGHT;
+    unsigned short cur_encoder = 0, prev_encoder = 0;
+    int i, diff, counts = 0;
+
+    writeDAC(addr, DAC_CMD_WRUP, word);
+    prev_encoder = encoder_read(wheel_direction);
+    for(i=0; i<ms; i++){
+        usleep(1000);
+        cur_encoder = encoder_read(wheel_direction);
+        diff = encoder_delta(cur_encoder, prev_encoder);
+        counts += (diff < 0) ? -diff : diff;
+        prev_encoder = cur_encoder;
+    }
+    return counts;
+}
+
+/*
+* 일정 DAC word에서 정상상태 속도(degree/sec) 측정. 앞의 절반은 과도응답으로 버림.
+*/
+static float comp_id_velocity(int wheel_direction, unsigned short word)
+{
+    comp_id_counts(wheel_direction, word, COMP_ID_VEL_MS / 2);
+    return (float)comp_id_counts(wheel_direction, word, COMP_ID_VEL_MS) * 360
+            / UNIT_ENCODER_RESOLUTION / GEAR_RATIO / (COMP_ID_VEL_MS * 0.001);
+}
+
+/*
+* 데드존/마찰 보상 값 자동 측정 함수
+* int comp_identify(int wheel_direction, int with_lut)
+* 입력 값 : wheel_direction ==> LEFT_WHEEL / RIGHT_WHEEL
+*         with_lut ==> 1 이면 LUT도 측정 (방향 당 약 COMP_LUT_SIZE * 0.3초 추가 소요)
+* 반환 값 : 성공 0 / 실패 -1 (실패한 방향은 기존 값 유지)
+* 설명 : 바퀴가 실제로 회전하므로 바퀴가 자유롭게 돌 수 있는 상태에서 실행할 것. 끝나면 브레이크를 다시 걺.
+*       1. DAC를 0부터 증가시키며 처음 움직이는 값 ==> breakaway
+*       2. breakaway에서 감소시키며 회전이 멈추기 직전 값 ==> coulomb
+*       3. coulomb 위 두 지점의 속도 차 ==> viscous
+*       4. (선택) coulomb ~ DAC_DATA_MAX 구간 속도를 측정하여 속도가 |u|에 비례하도록 역변환한 LUT
+*/
+int comp_identify(int wheel_direction, int with_lut)
+{
+    unsigned char addr = (wheel_direction == LEFT_WHEEL) ? DAC_ADDR_LEFT : DAC_ADDR_RIGHT;
+    struct motor_comp c;
+    unsigned short word = 0, w1 = 0, w2 = 0;
+    unsigned short lut_word[COMP_LUT_SIZE];
+    float v1 = 0, v2 = 0, target = 0, lut_vel[COMP_LUT_SIZE];
+    int d, i, j, ret = 0;
+
+    if( (wheel_direction != LEFT_WHEEL) & (wheel_direction != RIGHT_WHEEL) )    return -1;
+
+    brake_wheel(wheel_direction, BREAK_OFF);
+
+    for(d=BACKWARD; d<=FORWARD; d++){
+        comp_get(wheel_direction, d, &c);
+        set_direction(wheel_direction, d);
+
+        // 1. breakaway
+        for(word = DAC_DATA_MIN; word <= COMP_ID_WORD_MAX; word += COMP_ID_STEP)
+            if(comp_id_counts(wheel_direction, word, COMP_ID_HOLD_MS) >= COMP_ID_MOVE_CNT) break;
+
+        if(word > COMP_ID_WORD_MAX){
+            printf("COMP IDENTIFY ERROR : %s WHEEL %s does not move\n", (wheel_direction == LEFT_WHEEL) ? "LEFT" : "RIGHT",\
+                                                                    (d == FORWARD) ? "FORWARD" : "BACKWARD");
+            writeDAC(addr, DAC_CMD_WRUP, DAC_DATA_MIN);
+            ret = -1;
+            continue;
+        }
+        c.breakaway = word;
+
+        // 2. coulomb
+        while(word >= DAC_DATA_MIN + COMP_ID_STEP){
+            if(comp_id_counts(wheel_direction, word - COMP_ID_STEP, COMP_ID_HOLD_MS) < COMP_ID_MOVE_CNT) break;
+            word -= COMP_ID_STEP;
+        }
+        c.coulomb = word;
+
+        // 3. viscous
+        w1 = c.coulomb + (DAC_DATA_MAX - c.coulomb) / 4;
+        w2 = c.coulomb + (DAC_DATA_MAX - c.coulomb) * 3 / 4;
+        v1 = comp_id_velocity(wheel_direction, w1);
+        v2 = comp_id_velocity(wheel_direction, w2);
+        c.viscous = (v2 > v1) ? (float)(w2 - w1) / (v2 - v1) : 0;
+
+        // 4. LUT
+        c.lut_valid = 0;
+        if(with_lut){
+            for(i=0; i<COMP_LUT_SIZE; i++){
+                lut_word[i] = c.coulomb + (DAC_DATA_MAX - c.coulomb) * i / (COMP_LUT_SIZE - 1);
+                lut_vel[i]  = (i == 0) ? 0 : comp_id_velocity(wheel_direction, lut_word[i]);
+                if( (i > 0) && (lut_vel[i] < lut_vel[i-1]) ) lut_vel[i] = lut_vel[i-1];  // 단조 증가 보장
+            }
+            // |u| = i * DAC_DATA_MAX / (N-1) 일 때 속도가 i * vmax / (N-1) 이 되도록 역변환
+            if(lut_vel[COMP_LUT_SIZE - 1] > 0){
+                for(i=0, j=0; i<COMP_LUT_SIZE; i++){
+                    target = lut_vel[COMP_LUT_SIZE - 1] * i / (COMP_LUT_SIZE - 1);
+                    while( (j < COMP_LUT_SIZE - 2) && (lut_vel[j+1] < target) ) j++;
+                    if(lut_vel[j+1] > lut_vel[j])
+                        c.lut[i] = lut_word[j] + (lut_word[j+1] - lut_word[j]) * (target - lut_vel[j]) / (lut_vel[j+1] - lut_vel[j]);
+                    else
+                        c.lut[i] = lut_word[j];
+                }
+                c.lut_valid = 1;
+            }
+        }
+        writeDAC(addr, DAC_CMD_WRUP, DAC_DATA_MIN);
+        usleep(COMP_ID_VEL_MS * 1000);
+
+        comp_set(wheel_direction, d, &c);
+
+#ifdef M_DEBUG
+        printf("COMP %s WHEEL %s : breakaway 0x%x coulomb 0x%x viscous %.3f lut %s\n",\
+                (wheel_direction == LEFT_WHEEL) ? "LEFT" : "RIGHT", (d == FORWARD) ? "FORWARD" : "BACKWARD",\
+                c.breakaway, c.coulomb, c.viscous, c.lut_valid ? "on" : "off");
+#endif
+    }
+    brake_wheel(wheel_direction, BREAK_ON);
+    return ret;
+}
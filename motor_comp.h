@@ -0,0 +1,59 @@
+/*
+*********************************************************************************************************
+*                                              MOTOR_COMP.H
+*********************************************************************************************************
+*/
+#ifndef __MOTOR_COMP_H__
+#define __MOTOR_COMP_H__
+
+/*
+*********************************************************************************************************
+*                                  DAC DEAD-ZONE / FRICTION COMPENSATION
+* PI 제어기 출력은 0 ~ DAC_DATA_MAX 구간이 선형이라고 가정하지만 실제 모터는 DAC word 0x160 부근까지
+* 토크가 발생하지 않음(motor_func.h DAC_DATA_MIN 주석 참조).
+* 제어기와 writeDAC() 사이에서 바퀴/방향 별로 출력을 선형화 함.
+*   정지 상태 : word = breakaway + |u|
+*   이동 상태 : word = coulomb + COMP_VISCOUS_FRAC * viscous * vel + |u|  (vel 은 설정된 모터 방향 기준, 반대 방향 회전은 정지 상태)
+*   LUT 사용시 : word = lut(|u|) (정지 상태에서는 최소 breakaway 보장)
+* 두 상태 사이(COMP_VEL_STILL ~ COMP_VEL_MOVE)는 선형으로 섞어 출력이 튀지 않게 함.
+* viscous 는 측정 속도로 되먹임되는 항이므로(양의 속도 되먹임) 측정된 기울기 전체를 쓰면 모터의 감쇠가
+* 상쇄되어 속도가 유지되거나 폭주함. 1 보다 충분히 작은 비율(COMP_VISCOUS_FRAC)만 사용.
+* 보상 값들은 comp_identify()로 시작시 자동 측정하거나 comp_set()으로 직접 설정.
+*********************************************************************************************************
+*/
+#define COMP_DEADZONE_DEFAULT   0x160   // 실험적으로 측정된 토크 발생 최소 DAC word
+#define COMP_LUT_SIZE           17      // 0 ~ DAC_DATA_MAX 를 16 구간으로 나눈 테이블
+#define COMP_U_DEADBAND         1.0     // |u| 가 이 값보다 작으면 출력 0 (정지 유지)
+
+// 정지 판정 속도 (degree/sec) : 1 tick 동안 ENCODER_ERR 이하의 변화
+#define COMP_VEL_STILL          ((float)ENCODER_ERR * 360 / UNIT_ENCODER_RESOLUTION / GEAR_RATIO / dT)
+#define COMP_VEL_MOVE           (COMP_VEL_STILL * 2)    // 이 속도 이상이면 이동 상태 보상만 사용
+#define COMP_VISCOUS_FRAC       0.25    // 측정된 viscous 기울기 중 사용할 비율 (< 1)
+
+// 자동 측정 파라미터
+#define COMP_ID_STEP            0x008   // breakaway 탐색시 DAC 증가량
+#define COMP_ID_HOLD_MS         30      // 각 단계 유지 시간(ms)
+#define COMP_ID_VEL_MS          200     // 속도 측정 시간(ms)
+#define COMP_ID_MOVE_CNT        (ENCODER_ERR * 2)   // 움직임 판정 엔코더 변화량
+#define COMP_ID_WORD_MAX        0x300   // 이 값까지 움직이지 않으면 측정 실패
+
+struct motor_comp {
+    unsigned short  breakaway;              // 정지 마찰을 이기는 최소 DAC word
+    unsigned short  coulomb;                // 회전을 유지하는 최소 DAC word (쿨롱 마찰)
+    float           viscous;                // 속도 비례 마찰 보상 (DAC word / (degree/sec))
+    unsigned short  lut[COMP_LUT_SIZE];     // |u| -> DAC word 측정 테이블
+    int             lut_valid;
+};
+
+/*
+*********************************************************************************************************
+*                                              PREDEFINE FUNCTION
+*********************************************************************************************************
+*/
+void comp_init(void);
+void comp_enable(int on);
+int comp_set(int wheel_direction, int move_direction, const struct motor_comp *comp);
+int comp_get(int wheel_direction, int move_direction, struct motor_comp *comp);
+unsigned short comp_output(int wheel_direction, int move_direction, float u, float vel);
+int comp_identify(int wheel_direction, int with_lut);
+#endif
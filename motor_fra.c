@@ -0,0 +1,408 @@
+/*
+*********************************************************************************************************
+*                                             MOTOR_FRA_C
+*********************************************************************************************************
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+#include <complex.h>
+#include "motor_func.h"
+#include "motor_comp.h"
+#include "gain_sched.h"
+#include "motor_fra.h"
+
+/*
+*********************************************************************************************************
+*                                  FREQUENCY RESPONSE ANALYZER VARIABLE
+*********************************************************************************************************
+*/
+#define FRA_FS          (1.0 / dT)      // 샘플링 주파수 = 제어 주기
+#define FRA_SETTLE_MS   500             // 가진 전 동작점 도달 대기 시간
+
+// 한 주파수에 대한 Goertzel 필터 상태
+struct fra_goertzel {
+    double  coeff;
+    double  s1, s2;
+};
+
+// 주파수 bin 마다 제어 입력(u), 제어기 출력(u_c), 속도(y) 3개 신호의 Goertzel 상태
+struct fra_bin {
+    double              w;      // rad/sample
+    double              phase;  // multisine 위상
+    struct fra_goertzel u, uc, y;
+};
+
+// 가진 중 제어 tick 실행에 필요한 상태
+struct fra_ctx {
+    int                     wheel_direction;
+    unsigned char           addr;
+    unsigned short          prev_encoder;
+    const struct fra_cfg    *cfg;
+    struct timespec         next;
+};
+
+static struct fra_bin fra_bins[FRA_MAX_FREQ];
+
+static void fra_gz_init(struct fra_goertzel *g, double w)
+{
+    g->coeff    = 2 * cos(w);
+    g->s1       = 0;
+    g->s2       = 0;
+}
+
+static void fra_gz_push(struct fra_goertzel *g, double x)
+{
+    double s0 = x + g->coeff * g->s1 - g->s2;
+
+    g->s2 = g->s1;
+    g->s1 = s0;
+}
+
+// 같은 길이로 누적한 신호끼리의 비율만 사용하므로 공통 위상 항(e^-jw(N-1))은 생략
+static double complex fra_gz_result(const struct fra_goertzel *g, double w)
+{
+    return g->s1 - g->s2 * cexp(-I * w);
+}
+
+/*
+* 가진 신호 x를 더해 1 제어 주기를 실행하고 제어 입력/제어기 출력/속도를 반환.
+* 다음 주기 시작 시각까지 절대 시간으로 대기하므로 샘플 간격이 일정함.
+*/
+static void fra_tick(struct fra_ctx *c, double x, double *u_tot, double *u_c, double *y)
+{
+    unsigned short cur_encoder = 0;
+    float u = 0, vel = 0;
+    int diff = 0;
+
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &c->next, NULL);
+    c->next.tv_nsec += (long)(dT * 1000000000L);
+    if(c->next.tv_nsec >= 1000000000L){
+        c->next.tv_nsec -= 1000000000L;
+        c->next.tv_sec++;
+    }
+
+    if(c->cfg->loop == FRA_CLOSED_LOOP){
+        motor_set_inject(c->wheel_direction, x);
+        vel_control(c->cfg->ref_vel, c->wheel_direction, c->cfg->move_direction);
+        motor_get_output(c->wheel_direction, &u, &vel);
+        *u_c    = u;
+        *u_tot  = u + x;
+        *y      = vel;
+    }
+    else{
+        cur_encoder = encoder_read(c->wheel_direction);
+        diff = encoder_delta(cur_encoder, c->prev_encoder);
+        c->prev_encoder = cur_encoder;
+        vel = (float)((diff < 0) ? -diff : diff) * 360 / UNIT_ENCODER_RESOLUTION / GEAR_RATIO / dT;
+
+        *u_c    = 0;
+        *u_tot  = c->cfg->bias + x;
+        *y      = vel;
+
+        //마찰 보상에는 모터 방향 기준 부호 있는 속도 전달
+        diff *= ENC_SIGN(c->wheel_direction);
+        if(c->cfg->move_direction == BACKWARD) diff = -diff;
+        writeDAC(c->addr, DAC_CMD_WRUP, comp_output(c->wheel_direction, c->cfg->move_direction, (float)*u_tot,\
+                                                    (float)diff * 360 / UNIT_ENCODER_RESOLUTION / GEAR_RATIO / dT));
+    }
+}
+
+/*
+* 이산 시간 속도 PI 제어기(vel_control())의 주파수 응답
+* input_dac += Kp*e + Ki*e_i, e_i += e*dT  ==>  C(z) = z/(z-1) * (Kp + Ki*dT*z/(z-1))
+* gain scheduling 사용시 동작점(목표 속도)의 게인을 사용.
+*/
+static double complex fra_vel_pi(double w, const struct gs_gain *gain)
+{
+    double complex z = cexp(I * w);
+    double complex integ = z / (z - 1);
+
+    return integ * (gain->kp + gain->ki * dT * integ);
+}
+
+/*
+*********************************************************************************************************
+*                                  FREQUENCY RESPONSE ANALYZER FUNC
+*********************************************************************************************************
+*/
+
+/*
+* 기본 설정 값
+* void fra_default_cfg(struct fra_cfg *cfg)
+* 입력 값 : cfg ==> 채울 설정 구조체
+* 반환 값 : 없음
+* 설명 : 개루프, swept-sine, 1 ~ 200Hz 20개 주파수, 동작점 DAC 0x100 +- 0x40
+*/
+void fra_default_cfg(struct fra_cfg *cfg)
+{
+    cfg->mode           = FRA_SWEEP;
+    cfg->loop           = FRA_OPEN_LOOP;
+    cfg->move_direction = FORWARD;
+    cfg->f_min          = 1.0;
+    cfg->f_max          = 200.0;
+    cfg->n_freq         = 20;
+    cfg->amp            = 0x40;
+    cfg->bias           = 0x100;
+    cfg->ref_vel        = 360;
+    cfg->periods        = 10;
+    cfg->settle_periods = 3;
+    cfg->duration       = 4.0;
+}
+
+/*
+* 주파수 응답 측정 함수
+* int fra_run(int wheel_direction, const struct fra_cfg *cfg, struct fra_point *res)
+* 입력 값 : wheel_direction ==> LEFT_WHEEL / RIGHT_WHEEL
+*         cfg ==> 측정 설정 (fra_default_cfg() 참조)
+*         res ==> 결과를 저장할 배열 (cfg->n_freq 개 이상)
+* 반환 값 : 성공 측정한 주파수 개수 / 실패 -1
+* 설명 : 바퀴가 실제로 회전하므로 바퀴가 자유롭게 돌 수 있는 상태에서 실행할 것.
+*       FRA_SWEEP 은 주파수마다 (settle_periods + periods) 주기,
+*       FRA_MULTISINE 은 2 * duration 초가 소요됨 (앞의 절반은 과도응답으로 버림).
+*       FRA_MULTISINE 의 주파수는 측정 길이에 맞는 DFT bin으로 반올림됨.
+*/
+int fra_run(int wheel_direction, const struct fra_cfg *cfg, struct fra_point *res)
+{
+    struct fra_ctx ctx;
+    struct fra_bin *b;
+    double complex U, Uc, Y, P, L, T;
+    struct gs_gain gain;
+    double u_tot = 0, u_c = 0, y = 0, x = 0, peak = 0, scale = 0, f = 0;
+    long n = 0, N = 0, settle = 0, m = 0, prev_m = 0;
+    int k, n_freq;
+
+    if( (wheel_direction != LEFT_WHEEL) & (wheel_direction != RIGHT_WHEEL) )    return -1;
+    if( (cfg == NULL) | (res == NULL) )                                         return -1;
+    n_freq = cfg->n_freq;
+    if( (n_freq < 1) | (n_freq > FRA_MAX_FREQ) )                                return -1;
+    if( (cfg->f_min <= 0) | (cfg->f_max < cfg->f_min) | (cfg->f_max >= FRA_FS / 2) ) return -1;
+
+    ctx.wheel_direction = wheel_direction;
+    ctx.addr            = (wheel_direction == LEFT_WHEEL) ? DAC_ADDR_LEFT : DAC_ADDR_RIGHT;
+    ctx.cfg             = cfg;
+
+    //측정 주파수 (로그 간격)
+    if(cfg->mode == FRA_MULTISINE){
+        N = (long)(cfg->duration * FRA_FS);
+        if(N * cfg->f_min < FRA_FS) return -1;  // 최소 주파수가 1주기 이상 들어가야 함
+    }
+    for(k=0; k<n_freq; k++){
+        b = &fra_bins[k];
+        f = (n_freq == 1) ? cfg->f_min : cfg->f_min * pow(cfg->f_max / cfg->f_min, (double)k / (n_freq - 1));
+        if(cfg->mode == FRA_MULTISINE){
+            m = lround(f * N / FRA_FS);
+            if(m <= prev_m) m = prev_m + 1;
+            prev_m = m;
+            b->w = 2 * M_PI * m / N;
+            b->phase = -M_PI * k * (k - 1) / n_freq;   // Schroeder 위상 (최대값 최소화)
+        }
+        else
+            b->w = 2 * M_PI * f / FRA_FS;
+        res[k].freq = b->w * FRA_FS / (2 * M_PI);
+    }
+    if(fra_bins[n_freq - 1].w >= M_PI) return -1;
+
+    //동작점 도달 대기
+    brake_wheel(wheel_direction, BREAK_OFF);
+    set_direction(wheel_direction, cfg->move_direction);
+    ctx.prev_encoder = encoder_read(wheel_direction);
+    clock_gettime(CLOCK_MONOTONIC, &ctx.next);
+    for(n=0; n<FRA_SETTLE_MS; n++)
+        fra_tick(&ctx, 0, &u_tot, &u_c, &y);
+
+    if(cfg->mode == FRA_MULTISINE){
+        //진폭이 amp를 넘지 않도록 한 주기의 최대값으로 정규화
+        for(n=0, peak=0; n<N; n++){
+            for(k=0, x=0; k<n_freq; k++)
+                x += cos(fra_bins[k].w * n + fra_bins[k].phase);
+            if(fabs(x) > peak) peak = fabs(x);
+        }
+        scale = (peak > 0) ? cfg->amp / peak : 0;
+
+        for(k=0; k<n_freq; k++){
+            fra_gz_init(&fra_bins[k].u, fra_bins[k].w);
+            fra_gz_init(&fra_bins[k].uc, fra_bins[k].w);
+            fra_gz_init(&fra_bins[k].y, fra_bins[k].w);
+        }
+        for(n=0; n<2*N; n++){
+            for(k=0, x=0; k<n_freq; k++)
+                x += cos(fra_bins[k].w * n + fra_bins[k].phase);
+            fra_tick(&ctx, scale * x, &u_tot, &u_c, &y);
+            if(n < N) continue;
+            for(k=0; k<n_freq; k++){
+                fra_gz_push(&fra_bins[k].u, u_tot);
+                fra_gz_push(&fra_bins[k].uc, u_c);
+                fra_gz_push(&fra_bins[k].y, y);
+            }
+        }
+    }
+    else{
+        for(k=0; k<n_freq; k++){
+            b = &fra_bins[k];
+            //정수 주기가 되도록 길이를 정하고 주파수를 보정
+            N       = lround(cfg->periods * 2 * M_PI / b->w);
+            settle  = lround(cfg->settle_periods * 2 * M_PI / b->w);
+            b->w    = 2 * M_PI * cfg->periods / N;
+            res[k].freq = b->w * FRA_FS / (2 * M_PI);
+
+            fra_gz_init(&b->u, b->w);
+            fra_gz_init(&b->uc, b->w);
+            fra_gz_init(&b->y, b->w);
+            for(n=0; n<settle+N; n++){
+                fra_tick(&ctx, cfg->amp * sin(b->w * n), &u_tot, &u_c, &y);
+                if(n < settle) continue;
+                fra_gz_push(&b->u, u_tot);
+                fra_gz_push(&b->uc, u_c);
+                fra_gz_push(&b->y, y);
+            }
+#ifdef M_DEBUG
+            printf("FRA %.2f Hz done\n", res[k].freq);
+#endif
+        }
+    }
+
+    motor_set_inject(wheel_direction, 0);
+    writeDAC(ctx.addr, DAC_CMD_WRUP, DAC_DATA_MIN);
+
+    //주파수 응답 계산
+    gs_lookup(wheel_direction, GS_CTRL_VEL, cfg->ref_vel, 0, cfg->bias, &gain);
+    for(k=0; k<n_freq; k++){
+        b   = &fra_bins[k];
+        U   = fra_gz_result(&b->u, b->w);
+        Uc  = fra_gz_result(&b->uc, b->w);
+        Y   = fra_gz_result(&b->y, b->w);
+        if(cabs(U) == 0) U = 1e-12;
+
+        P = Y / U;
+        L = (cfg->loop == FRA_CLOSED_LOOP) ? -Uc / U : fra_vel_pi(b->w, &gain) * P;
+        T = L / (1 + L);
+
+        res[k].p_re = creal(P);  res[k].p_im = cimag(P);
+        res[k].l_re = creal(L);  res[k].l_im = cimag(L);
+        res[k].t_re = creal(T);  res[k].t_im = cimag(T);
+    }
+    return n_freq;
+}
+
+/*
+* 1차 모터 모델 추정 함수
+* int fra_fit_model(const struct fra_point *res, int n, struct fra_model *model)
+* 입력 값 : res ==> fra_run() 결과
+*         n ==> 주파수 개수
+*         model ==> 결과 모델
+* 반환 값 : 성공 0 / 실패 -1
+* 설명 : P(s) = K * e^(-theta s) / (tau s + 1)
+*       1/|P|^2 = 1/K^2 + (tau/K)^2 * w^2 를 (상대 오차로 가중한) 최소자승으로 풀어 K, tau를 구하고
+*       남은 위상 -w*theta 로 지연 시간을 구함. 개루프 L의 |L| = 1 지점에서 위상 여유 계산.
+*/
+int fra_fit_model(const struct fra_point *res, int n, struct fra_model *model)
+{
+    double s = 0, sx = 0, sy = 0, sxx = 0, sxy = 0, swr = 0, sww = 0;
+    double w, mag, wt, a, b, det, ph, prev_ph = 0, off = 0;
+    double lmag, prev_lmag = 0, lph, prev_lph = 0, loff = 0, r;
+    int k;
+
+    if( (res == NULL) | (model == NULL) | (n < 2) ) return -1;
+
+    for(k=0; k<n; k++){
+        w   = 2 * M_PI * res[k].freq;
+        mag = res[k].p_re * res[k].p_re + res[k].p_im * res[k].p_im;
+        if(mag <= 0) return -1;
+        wt   = mag * mag;      // 상대 오차 기준 (고주파 영역에 치우치지 않도록)
+        s   += wt;
+        sx  += wt * w * w;
+        sy  += wt / mag;
+        sxx += wt * w * w * w * w;
+        sxy += wt * w * w / mag;
+    }
+    det = s * sxx - sx * sx;
+    if(det == 0) return -1;
+    a = (sy * sxx - sx * sxy) / det;
+    b = (s * sxy - sx * sy) / det;
+    if(a <= 0) return -1;
+    if(b < 0) b = 0;
+
+    model->K            = 1 / sqrt(a);
+    model->tau          = sqrt(b / a);
+    model->bandwidth    = (model->tau > 0) ? 1 / (2 * M_PI * model->tau) : res[n-1].freq;
+
+    //지연 시간 : 위상을 unwrap 한 후 1차 모델 위상과의 차이
+    for(k=0; k<n; k++){
+        w   = 2 * M_PI * res[k].freq;
+        ph  = atan2(res[k].p_im, res[k].p_re);
+        if(k > 0){
+            while(ph + off - prev_ph > M_PI)  off -= 2 * M_PI;
+            while(ph + off - prev_ph < -M_PI) off += 2 * M_PI;
+        }
+        ph += off;
+        prev_ph = ph;
+        swr += w * (ph + atan(w * model->tau));
+        sww += w * w;
+    }
+    model->theta = (sww > 0) ? -swr / sww : 0;
+    if(model->theta < 0) model->theta = 0;
+
+    //개루프 교차 주파수, 위상 여유
+    model->crossover    = 0;
+    model->phase_margin = 0;
+    for(k=0; k<n; k++){
+        lmag = sqrt(res[k].l_re * res[k].l_re + res[k].l_im * res[k].l_im);
+        lph  = atan2(res[k].l_im, res[k].l_re);
+        if(k > 0){
+            while(lph + loff - prev_lph > M_PI)  loff -= 2 * M_PI;
+            while(lph + loff - prev_lph < -M_PI) loff += 2 * M_PI;
+        }
+        lph += loff;
+        if( (k > 0) && (prev_lmag >= 1) && (lmag < 1) ){
+            r = log(prev_lmag) / (log(prev_lmag) - log(lmag));
+            model->crossover    = res[k-1].freq * pow(res[k].freq / res[k-1].freq, r);
+            model->phase_margin = 180 + (prev_lph + (lph - prev_lph) * r) * 180 / M_PI;
+            break;
+        }
+        prev_lmag   = lmag;
+        prev_lph    = lph;
+    }
+    return 0;
+}
+
+/*
+* Bode 데이터 저장 함수
+* int fra_export(const char *path, const struct fra_point *res, int n, const struct fra_model *model)
+* 입력 값 : path ==> 저장할 파일 경로 (CSV)
+*         res ==> fra_run() 결과
+*         n ==> 주파수 개수
+*         model ==> fra_fit_model() 결과 (NULL 가능)
+* 반환 값 : 성공 0 / 실패 -1
+* 설명 : '#'으로 시작하는 주석 줄에 모델을 기록하고
+*       freq_hz, P/L/T 의 크기(dB)와 위상(degree)을 한 줄씩 기록.
+*/
+int fra_export(const char *path, const struct fra_point *res, int n, const struct fra_model *model)
+{
+    FILE *fp;
+    int k;
+
+    if( (path == NULL) | (res == NULL) ) return -1;
+    if((fp = fopen(path, "w")) == NULL){
+        printf("fra export open error\n");
+        return -1;
+    }
+
+    if(model != NULL){
+        fprintf(fp, "# model P(s) = K * exp(-theta s) / (tau s + 1)\n");
+        fprintf(fp, "# K %g tau %g theta %g bandwidth_hz %g\n", model->K, model->tau, model->theta, model->bandwidth);
+        fprintf(fp, "# crossover_hz %g phase_margin_deg %g\n", model->crossover, model->phase_margin);
+    }
+    fprintf(fp, "freq_hz,p_mag_db,p_phase_deg,l_mag_db,l_phase_deg,t_mag_db,t_phase_deg\n");
+    for(k=0; k<n; k++){
+        fprintf(fp, "%g,%g,%g,%g,%g,%g,%g\n", res[k].freq,
+                10 * log10(res[k].p_re * res[k].p_re + res[k].p_im * res[k].p_im + 1e-30), atan2(res[k].p_im, res[k].p_re) * 180 / M_PI,
+                10 * log10(res[k].l_re * res[k].l_re + res[k].l_im * res[k].l_im + 1e-30), atan2(res[k].l_im, res[k].l_re) * 180 / M_PI,
+                10 * log10(res[k].t_re * res[k].t_re + res[k].t_im * res[k].t_im + 1e-30), atan2(res[k].t_im, res[k].t_re) * 180 / M_PI);
+    }
+    fclose(fp);
+    return 0;
+}
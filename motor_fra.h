@@ -0,0 +1,72 @@
+/*
+*********************************************************************************************************
+*                                              MOTOR_FRA.H
+*********************************************************************************************************
+*/
+#ifndef __MOTOR_FRA_H__
+#define __MOTOR_FRA_H__
+
+/*
+*********************************************************************************************************
+*                                  FREQUENCY RESPONSE ANALYZER
+* DAC 명령 위에 가진 신호(swept-sine / multisine)를 더하고 같은 제어 주기로 엔코더 속도를 기록하여
+* 각 주파수에서의 응답을 Goertzel 알고리즘으로 실시간 계산함 (샘플을 저장하지 않음).
+*   P(jw) : 플랜트 (DAC 제어량 -> 바퀴 속도 degree/sec)
+*   L(jw) : 개루프 (제어기 * 플랜트)
+*   T(jw) : 폐루프 L / (1 + L)
+* FRA_OPEN_LOOP  : bias + 가진 신호를 직접 출력. P를 측정하고 L, T는 vel_control()의 PI 이득으로 계산.
+* FRA_CLOSED_LOOP : vel_control() 동작 중 제어 출력에 가진 신호를 더함 (motor_set_inject()).
+*                   주입점 앞뒤의 신호로 L = -u_c / (u_c + d)를 직접 측정.
+* 측정 결과로 1차 모터 모델 K * e^(-theta s) / (tau s + 1) 을 최소자승으로 구함.
+* 바퀴는 한 방향으로만 회전한다고 가정하므로 bias(또는 ref_vel)는 가진 진폭보다 충분히 커야 함.
+*********************************************************************************************************
+*/
+#define FRA_MAX_FREQ        32
+
+#define FRA_SWEEP           0   // 주파수마다 순서대로 정현파 가진 (stepped swept-sine)
+#define FRA_MULTISINE       1   // 모든 주파수를 동시에 가진 (Schroeder 위상)
+
+#define FRA_OPEN_LOOP       0
+#define FRA_CLOSED_LOOP     1
+
+struct fra_cfg {
+    int             mode;           // FRA_SWEEP / FRA_MULTISINE
+    int             loop;           // FRA_OPEN_LOOP / FRA_CLOSED_LOOP
+    int             move_direction; // FORWARD / BACKWARD
+    float           f_min;          // 최소 주파수 (Hz)
+    float           f_max;          // 최대 주파수 (Hz, 1 / (2 * dT) 미만)
+    int             n_freq;         // 측정 주파수 개수 (로그 간격, FRA_MAX_FREQ 이하)
+    float           amp;            // 가진 진폭 (DAC 제어량)
+    float           bias;           // FRA_OPEN_LOOP 동작점 (DAC 제어량)
+    int             ref_vel;        // FRA_CLOSED_LOOP 목표 속도 (degree/sec)
+    int             periods;        // FRA_SWEEP 주파수당 측정 주기 수
+    int             settle_periods; // FRA_SWEEP 주파수당 과도응답 대기 주기 수
+    float           duration;       // FRA_MULTISINE 측정 시간 (sec, 1 / f_min 이상)
+};
+
+struct fra_point {
+    float           freq;           // Hz
+    float           p_re, p_im;     // 플랜트
+    float           l_re, l_im;     // 개루프
+    float           t_re, t_im;     // 폐루프
+};
+
+struct fra_model {
+    float           K;              // DC 이득 ((degree/sec) / DAC 제어량)
+    float           tau;            // 시정수 (sec)
+    float           theta;          // 지연 시간 (sec)
+    float           bandwidth;      // 플랜트 대역폭 (Hz)
+    float           crossover;      // 개루프 교차 주파수 (Hz, 없으면 0)
+    float           phase_margin;   // 위상 여유 (degree)
+};
+
+/*
+*********************************************************************************************************
+*                                              PREDEFINE FUNCTION
+*********************************************************************************************************
+*/
+void fra_default_cfg(struct fra_cfg *cfg);
+int fra_run(int wheel_direction, const struct fra_cfg *cfg, struct fra_point *res);
+int fra_fit_model(const struct fra_point *res, int n, struct fra_model *model);
+int fra_export(const char *path, const struct fra_point *res, int n, const struct fra_model *model);
+#endif
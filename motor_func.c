@@ -7,7 +7,14 @@
 #include <stdlib.h>
 #include <unistd.h> 
 #include <stdint.h> 
+#include <string.h>
+#include <time.h>
 #include "motor_func.h"
+#include "motor_comp.h"
+#include "gain_sched.h"
+#include "flight_rec.h"
+#include "estop.h"
+#include "motor_trace.h"
 #include "rpi_func.h"
 
 /*
@@ -16,6 +23,33 @@
 *********************************************************************************************************
 */
 
+// 바퀴별 SPI 채널. 축마다 다른 SPI 버스를 사용할 경우 motor_set_spi()로 변경.
+static int motor_dac_ch[2] = {SPI_DAC_CHANNEL, SPI_DAC_CHANNEL};         // [RIGHT_WHEEL, LEFT_WHEEL]
+static int motor_enc_ch[2] = {SPI_ENC_R_CHANNEL, SPI_ENC_L_CHANNEL};     // [RIGHT_WHEEL, LEFT_WHEEL]
+
+// 제어기 출력에 더해지는 가진 신호와 마지막 제어 출력/측정 속도 (주파수 응답 분석용, motor_fra.c 참조)
+static float ctrl_inject[2] = {0,};
+static float ctrl_u[2] = {0,};
+static float ctrl_vel[2] = {0,};
+static unsigned short ctrl_dac[2] = {0,};   // 직전 DAC word (gain scheduling 동작점)
+static float ctrl_err[2] = {0,};            // 직전 tick 제어 오차 (rate_mgr.c 정지 판정)
+static int ctrl_mode[2] = {GS_CTRL_POS, GS_CTRL_POS};   // 직전 tick 제어기 종류 (ctrl_err 단위)
+static int motor_brake[2] = {BREAK_OFF, BREAK_OFF};
+
+// 제어 주기 (sec). 기본 dT, 주기를 바꾸는 경우(rate_mgr.c) motor_set_period()로 변경.
+static float ctrl_dT = dT;
+
+// 엔코더 oversampling (encoder_read_os() 참조). budget 0 이면 제어기는 encoder_read() 사용
+static int              enc_os_budget_us = 0;
+static long             enc_os_frame_ns[2] = {0,};  // 프레임 1개당 측정된 버스 시간 (이동 평균)
+static int              enc_os_valid[2] = {0,};
+
+// 엔코더 값을 사용할 수 없어 제어 연산을 건너뛴 연속 tick 수 (다음 유효 tick 의 속도 계산에 반영)
+static int              ctrl_hold[2] = {0,};
+
+// 바퀴별 마지막으로 유효했던 엔코더 값 (encoder_read(), encoder_read_os())
+static unsigned short   enc_last[2] = {0,};
+
 /*
 * 하드웨어 초기화 함수
 * int motor_hw_init(void)
@@ -28,13 +62,18 @@ int motor_hw_init(void)
 {
     int init_hw_out[4] = {PIN_MOTOR_BREAK_L, PIN_MOTOR_BREAK_R, \
                           PIN_MOTOR_DIRECTION_L, PIN_MOTOR_DIRECTION_R };
-    int i,ret;
+    unsigned int mask = 0;
+    int i,ret = 0;
 
-    /* gpio 핀을 출력으로 설정하고 0으로 출력 초기화*/
+    /* gpio 핀을 출력으로 설정하고 ON으로 출력 초기화 (한번에 설정, gpio cdev 는 여기서 line request 1번) */
     for(i=0; i<sizeof(init_hw_out)/sizeof(int); i++){
-        if((ret = rpi_gpio_direction(init_hw_out[i],OUTPUT)) < 0)   break;
-        if((ret = rpi_gpio_write(init_hw_out[i],ON)) < 0)          break;
+        if((ret = rpi_gpio_direction(init_hw_out[i],OUTPUT)) < 0)   return ret;
+        mask |= 1u << init_hw_out[i];
     }
+    if((ret = rpi_gpio_request_lines(mask)) < 0)    return ret;
+    if((ret = rpi_gpio_write_mask(mask,0)) < 0)     return ret;
+    frec_note_gpio(FREC_GPIO_BREAK_L | FREC_GPIO_BREAK_R, BREAK_ON == ON);
+    frec_note_gpio(FREC_GPIO_DIR_L | FREC_GPIO_DIR_R, FORWARD == ON);
     return ret;
 }
 
@@ -51,6 +90,7 @@ int brake_wheel(int wheel_direction, int cmd)
 
     if( (wheel_direction != LEFT_WHEEL) & (wheel_direction != RIGHT_WHEEL) )    return -1;
     if( (cmd != BREAK_ON) & (cmd != BREAK_OFF) )                                return -1;
+    if( (cmd == BREAK_OFF) & estop_is_latched() )                               return -1;  // 비상 정지 중 브레이크 해제 불가
     
     direction   = (wheel_direction == LEFT_WHEEL) ? PIN_MOTOR_BREAK_L : PIN_MOTOR_BREAK_R;
     flag        = (cmd == BREAK_ON) ? BREAK_ON : BREAK_OFF;
@@ -60,6 +100,15 @@ int brake_wheel(int wheel_direction, int cmd)
         return -1;
     }
 
+    //확인 후 쓰기 전에 비상 정지가 동작했다면 방금 해제한 브레이크를 다시 동작시킴 (writeDAC()와 같은 방식)
+    if( (cmd == BREAK_OFF) & estop_is_latched() ){
+        estop_fire(ESTOP_SRC_CONTROL);
+        motor_brake[wheel_direction] = BREAK_ON;
+        return -1;
+    }
+    frec_note_gpio((wheel_direction == LEFT_WHEEL) ? FREC_GPIO_BREAK_L : FREC_GPIO_BREAK_R, cmd == BREAK_ON);
+    motor_brake[wheel_direction] = cmd;
+
 #ifdef M_DEBUG
     printf("BREAK %s %s \n", (wheel_direction == LEFT_WHEEL) ? "LEFT WHEEL" : "RIGHT WHEEL",\
                               (cmd == BREAK_ON) ? "ON" : "OFF");
@@ -88,6 +137,7 @@ int set_direction(int wheel_direction, int cmd)
         printf("Set Direction Gpio Write Error\n");
         return -1;
     }
+    frec_note_gpio((wheel_direction == LEFT_WHEEL) ? FREC_GPIO_DIR_L : FREC_GPIO_DIR_R, cmd == FORWARD);
     
 #ifdef M_DEBUG
     printf("SET DIRECTION : %s Move %s \n", (wheel_direction == LEFT_WHEEL) ? "LEFT WHEEL" : "RIGHT WHEEL",\
@@ -98,6 +148,71 @@ int set_direction(int wheel_direction, int cmd)
 }
 
 
+/*
+* 바퀴별 SPI 채널 설정 함수
+* int motor_set_spi(int wheel_direction, int dac_channel, int enc_channel)
+* 입력 값 : wheel_direction ==> LEFT_WHEEL / RIGHT_WHEEL
+*         dac_channel ==> 해당 바퀴의 DAC가 연결된 spi 채널 (rpi_spi_setup_bus() 참조)
+*         enc_channel ==> 해당 바퀴의 엔코더가 연결된 spi 채널
+* 반환 값 : 성공 0 / 실패 -1
+* 설명 : 기본값은 SPI_DAC_CHANNEL, SPI_ENC_L_CHANNEL / SPI_ENC_R_CHANNEL (spidev0.x).
+*       축별 제어 스레드(axis_rt.c)가 서로 다른 버스를 사용하도록 할 때 사용.
+*/
+int motor_set_spi(int wheel_direction, int dac_channel, int enc_channel)
+{
+    if( (wheel_direction != LEFT_WHEEL) & (wheel_direction != RIGHT_WHEEL) )    return -1;
+    if( (dac_channel < 0) | (dac_channel >= SPI_MAX_DEV) )                      return -1;
+    if( (enc_channel < 0) | (enc_channel >= SPI_MAX_DEV) )                      return -1;
+
+    motor_dac_ch[wheel_direction] = dac_channel;
+    motor_enc_ch[wheel_direction] = enc_channel;
+    return 0;
+}
+
+/*
+* 바퀴별 SPI 채널 읽기 함수
+* int motor_get_spi(int wheel_direction, int *dac_channel, int *enc_channel)
+* 입력 값 : wheel_direction ==> LEFT_WHEEL / RIGHT_WHEEL
+*         dac_channel, enc_channel ==> 채널 번호를 받아올 변수 (NULL 가능)
+* 반환 값 : 성공 0 / 실패 -1
+*/
+int motor_get_spi(int wheel_direction, int *dac_channel, int *enc_channel)
+{
+    if( (wheel_direction != LEFT_WHEEL) & (wheel_direction != RIGHT_WHEEL) )    return -1;
+
+    if(dac_channel) *dac_channel = motor_dac_ch[wheel_direction];
+    if(enc_channel) *enc_channel = motor_enc_ch[wheel_direction];
+    return 0;
+}
+
+/*
+* 두 바퀴가 하나의 DAC(같은 spi 채널)를 공유하는지 확인
+* int motor_dac_shared(void)
+* 반환 값 : 공유 1 / 분리 0
+*/
+int motor_dac_shared(void)
+{
+    return motor_dac_ch[LEFT_WHEEL] == motor_dac_ch[RIGHT_WHEEL];
+}
+
+/*
+* 바퀴 spi 버스 상태 함수
+* int motor_health(int wheel_direction)
+* 입력 값 : wheel_direction ==> LEFT_WHEEL / RIGHT_WHEEL
+* 반환 값 : 바퀴의 DAC, 엔코더 채널 중 나쁜 쪽의 상태 SPI_ST_OK / SPI_ST_DEGRADED / SPI_ST_FAILED
+* 설명 : DEGRADED 는 재시도/클럭 저하로 동작 중이며, FAILED 이면 제어를 멈추고 정지할 것.
+*/
+int motor_health(int wheel_direction)
+{
+    int dac, enc;
+
+    if( (wheel_direction != LEFT_WHEEL) & (wheel_direction != RIGHT_WHEEL) )    return SPI_ST_FAILED;
+
+    dac = rpi_spi_state(motor_dac_ch[wheel_direction]);
+    enc = rpi_spi_state(motor_enc_ch[wheel_direction]);
+    return (dac > enc) ? dac : enc;
+}
+
 /*
 * DAC를 통해 모터에 제어 입력 보내는 함수
 * int writeDAC(unsigned char addr, unsigned char cmd, unsigned short data)
@@ -109,11 +224,16 @@ int set_direction(int wheel_direction, int cmd)
 *       총 24비트로 이루어짐.
 *       C3 C2 C1 C0 A3 A2 A1 A0 D9 D8 D7 D6 D5 D4 D3 D2 D1 D0 XX XX XX XX XX XX 
 *       최상위 4비트 : Command / 다음 4비트 : Address / 다음 10비트 : Data / 다음 6비트 : Don't care
+*       바퀴별 DAC가 다른 spi 채널에 있으면 DAC_ADDR_ALL은 두 채널 모두에 전송.
+*       비상 정지(estop.c) 중에는 출력하지 않으며, 호출될 때마다 watchdog 을 갱신함.
 */
 int writeDAC(unsigned char addr, unsigned char cmd, unsigned short data)
 {
     unsigned char buff[3]={0,}; 
-    int ret = 0;
+    int ret = 0, channel = 0;
+
+    if(estop_is_latched()) return -1;
+    estop_kick();
 
     //임계값 처리
     if(data>DAC_DATA_MAX) data = DAC_DATA_MAX;
@@ -128,9 +248,28 @@ int writeDAC(unsigned char addr, unsigned char cmd, unsigned short data)
     printf("data : %x send_data : %x \n", data, (buff[0]<<16)|(buff[1]<<8)|buff[2]);
 #endif
 
-    if((ret = rpi_spi_data_rw(SPI_DAC_CHANNEL , buff, 3)) < 0)
+    frec_note_dac(addr, data);
+
+    channel = (addr == DAC_ADDR_LEFT) ? motor_dac_ch[LEFT_WHEEL] : motor_dac_ch[RIGHT_WHEEL];
+    if((ret = rpi_spi_transfer(channel, buff, 3, 1)) < 0)
         printf("SPI DATA WRITE ERROR\n");
 
+    //DAC가 분리되어 있는 경우 왼쪽 DAC에도 전송 (rx로 덮어쓰인 buff 재설정)
+    if( (addr == DAC_ADDR_ALL) & !motor_dac_shared() ){
+        buff[0] = cmd<<4 | addr;  
+        buff[1] = (data<<6)>>8; 
+        buff[2] = data<<6; 
+        if(rpi_spi_transfer(motor_dac_ch[LEFT_WHEEL], buff, 3, 1) < 0){
+            printf("SPI DATA WRITE ERROR\n");
+            ret = -1;
+        }
+    }
+
+    //전송 중 비상 정지가 동작했다면 방금 쓴 값을 다시 0으로 덮어씀
+    if(estop_is_latched()) estop_fire(ESTOP_SRC_CONTROL);
+
+    MOTOR_TRACE4(dac_write, addr, cmd, data, ret);
+
     return ret;
 }
 
@@ -139,20 +278,35 @@ int writeDAC(unsigned char addr, unsigned char cmd, unsigned short data)
 * unsigned short encoder_read(int wheel_direction)
 * 입력 값 : wheel_direction ==>  LEFT_WHEEL / RIGHT_WHEEL //읽어올 wheel의 방향
 * 반환 값 : 읽어온 encoder 데이터의 값/ 실패 -1
+*         전송 실패 또는 무효한 프레임(encoder_decode())이면 마지막 유효 값. 버스 상태는 motor_health()로 확인.
+*         유효 여부가 필요하면(제어기) encoder_read_checked() 사용.
 */
 unsigned short encoder_read(int wheel_direction)
 {
-    int ret = -1, en_data = 0;
+    unsigned short pos = (unsigned short)-1;
+
+    encoder_read_checked(wheel_direction, &pos);
+    return pos;
+}
+
+/*
+* Encoder 데이터 읽기 + 유효 여부 확인 함수
+* int encoder_read_checked(int wheel_direction, unsigned short *pos)
+* 입력 값 : wheel_direction ==>  LEFT_WHEEL / RIGHT_WHEEL
+*         pos ==> 읽어온 encoder 데이터의 값. 사용할 수 없으면 마지막 유효 값 (첫 유효 값 전에는 0)
+* 반환 값 : 유효 0 / 전송 실패, 무효한 프레임, 잘못된 인자 -1
+*/
+int encoder_read_checked(int wheel_direction, unsigned short *pos)
+{
+    int ret = -1, en_data = 0, valid = 0;
     unsigned short en_re_data = 0, en_cmd_data = 0;
     unsigned char buf[3] = {0,};
 #ifdef E_DEBUG
     int i=0;
 #endif
 
-    if(wheel_direction == LEFT_WHEEL)
-        ret = rpi_spi_data_rw(SPI_ENC_L_CHANNEL,buf,3);
-    else if(wheel_direction == RIGHT_WHEEL)
-        ret = rpi_spi_data_rw(SPI_ENC_R_CHANNEL,buf,3);
+    if( (wheel_direction == LEFT_WHEEL) | (wheel_direction == RIGHT_WHEEL) )
+        ret = rpi_spi_transfer(motor_enc_ch[wheel_direction],buf,3,1);
     else{
         printf("Invalid Argument \n");
         return -1;
@@ -161,6 +315,9 @@ unsigned short encoder_read(int wheel_direction)
     en_data     = ((buf[0] << 16 | buf[1] << 8 | buf[2]) >> 5) & 0x0003ffff;
     en_re_data  = (en_data)>>6;
     en_cmd_data = (en_data)&0x003f;
+    frec_note_encoder(wheel_direction, buf, en_re_data);
+    MOTOR_TRACE6(enc_read, wheel_direction, buf[0] << 16 | buf[1] << 8 | buf[2], en_re_data, en_cmd_data,\
+                           !__builtin_parity(en_data), ret);
 
 #ifdef E_DEBUG
     printf("read %d bit\t",ret*sizeof(char));
@@ -176,7 +333,216 @@ unsigned short encoder_read(int wheel_direction)
                                  (en_cmd_data&0x01)>>0   // Even Parity : transmission error detection.
                                  );
 #endif
-    return en_re_data;
+
+    //전송 실패 또는 무효한 프레임이면 마지막 유효 값 유지 (parity 오류는 버스 상태에 반영)
+    if(ret >= 0) valid = encoder_decode(buf, NULL, NULL);
+    if( (ret < 0) | (valid < 0) ){
+        if(valid == -2) rpi_spi_note_error(motor_enc_ch[wheel_direction]);
+        if(pos) *pos = enc_last[wheel_direction];
+        return -1;
+    }
+    enc_last[wheel_direction] = en_re_data;
+    if(pos) *pos = en_re_data;
+    return 0;
+}
+
+/*
+* 엔코더 프레임 해석 함수
+* int encoder_decode(const unsigned char *raw, unsigned short *pos, unsigned short *status)
+* 입력 값 : raw ==> spi 로 읽은 3 byte 프레임
+*         pos ==> 엔코더 값 (0 ~ UNIT_ENCODER_RESOLUTION), NULL 가능
+*         status ==> 상태 비트 ENC_ST_*, NULL 가능
+* 반환 값 : 유효 0 / parity 오류 -2 / 그 외 무효 -1
+* 설명 : parity 오류, OCF 미완료, COF, LIN, 자기장 범위 초과 중 하나라도 해당하면 무효.
+*       parity 오류는 전송(버스) 오류, 나머지는 센서 상태 오류.
+*/
+int encoder_decode(const unsigned char *raw, unsigned short *pos, unsigned short *status)
+{
+    int en_data = ((raw[0] << 16 | raw[1] << 8 | raw[2]) >> 5) & 0x0003ffff;
+    unsigned short en_cmd_data = en_data & 0x003f;
+
+    if(pos)     *pos    = en_data >> 6;
+    if(status)  *status = en_cmd_data;
+
+    if(__builtin_parity(en_data))                                   return -2;
+    if(!(en_cmd_data & ENC_ST_OCF))                                 return -1;
+    if(en_cmd_data & (ENC_ST_COF | ENC_ST_LIN))                     return -1;
+    if((en_cmd_data & (ENC_ST_MAGINC | ENC_ST_MAGDEC)) == (ENC_ST_MAGINC | ENC_ST_MAGDEC)) return -1;
+    return 0;
+}
+
+/*
+* Encoder oversampling 읽기 함수
+* unsigned short encoder_read_os(int wheel_direction, int budget_us, int *confidence)
+* 입력 값 : wheel_direction ==> LEFT_WHEEL / RIGHT_WHEEL
+*         budget_us ==> 이번 tick 에 엔코더 읽기에 사용할 수 있는 버스 시간 (us)
+*         confidence ==> ENC_CONF_*, NULL 가능
+* 반환 값 : 유효 프레임들의 중앙값 / 유효 프레임이 없으면 마지막 유효 값 / 실패 -1
+* 설명 : 프레임 1개의 버스 시간을 측정하여 budget_us 안에 들어가는 K(1 ~ ENC_OS_MAX)개의 프레임을
+*       rpi_spi_transfer()로 한번에 읽음. 처음 호출시에는 측정을 위해 1개만 읽음.
+*       0xfff <--> 0x000 경계를 고려하여 첫 유효 프레임 기준 변화량(encoder_delta())의 중앙값을 구하고,
+*       중앙값과 ENC_OS_AGREE 이내인 프레임이 과반이면 ENC_CONF_HIGH, 아니면 마지막 유효 값에 가장 가까운 프레임을 사용.
+*/
+unsigned short encoder_read_os(int wheel_direction, int budget_us, int *confidence)
+{
+    unsigned char buf[ENC_OS_MAX * 3] = {0,};
+    unsigned short pos[ENC_OS_MAX], st[ENC_OS_MAX] = {0,}, result = 0;
+    int delta[ENC_OS_MAX], frame[ENC_OS_MAX], k = 1, n = 0, agree = 0, best = 0, conf = ENC_CONF_NONE;
+    int i, j, tmp, med, ret, raw;
+    long frame_ns;
+    struct timespec t0, t1;
+
+    if( (wheel_direction != LEFT_WHEEL) & (wheel_direction != RIGHT_WHEEL) ){
+        printf("Invalid Argument \n");
+        return -1;
+    }
+
+    //budget 안에 들어가는 프레임 수 결정
+    if(enc_os_frame_ns[wheel_direction] > 0){
+        k = (int)((long)budget_us * 1000 / enc_os_frame_ns[wheel_direction]);
+        if(k < 1)           k = 1;
+        if(k > ENC_OS_MAX)  k = ENC_OS_MAX;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    ret = rpi_spi_transfer(motor_enc_ch[wheel_direction], buf, 3, k);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    if(ret > 0){
+        frame_ns = ((t1.tv_sec - t0.tv_sec) * 1000000000L + (t1.tv_nsec - t0.tv_nsec)) / k;
+        if(enc_os_frame_ns[wheel_direction] == 0)   enc_os_frame_ns[wheel_direction] = frame_ns;
+        else enc_os_frame_ns[wheel_direction] = (enc_os_frame_ns[wheel_direction] * 3 + frame_ns) / 4;
+
+        //유효 프레임만 모음
+        for(i=0, tmp=0; i<k; i++){
+            if((j = encoder_decode(&buf[i*3], &pos[n], &st[n])) == 0)   frame[n++] = i;
+            else if(j == -2)                                            tmp++;
+        }
+        //유효 프레임이 없고 parity 오류가 있으면 버스 상태에 반영
+        if( (n == 0) & (tmp > 0) ) rpi_spi_note_error(motor_enc_ch[wheel_direction]);
+    }
+
+    if(n > 0){
+        //첫 유효 프레임 기준 변화량을 정렬하여 중앙값 계산
+        for(i=0; i<n; i++) delta[i] = encoder_delta(pos[i], pos[0]);
+        for(i=1; i<n; i++){
+            tmp = delta[i];
+            for(j=i; (j > 0) && (delta[j-1] > tmp); j--) delta[j] = delta[j-1];
+            delta[j] = tmp;
+        }
+        med     = delta[(n-1)/2];
+        result  = (unsigned short)((pos[0] + med) & UNIT_ENCODER_RESOLUTION);
+
+        for(i=0; i<n; i++)
+            if(abs(delta[i] - med) <= ENC_OS_AGREE) agree++;
+        conf = (agree * 2 > k) ? ENC_CONF_HIGH : ENC_CONF_LOW;
+
+        //과반이 없으면 마지막 유효 값에 가장 가까운 프레임 사용
+        if( (conf == ENC_CONF_LOW) & enc_os_valid[wheel_direction] ){
+            for(i=1, j=0; i<n; i++)
+                if(abs(encoder_delta(pos[i], enc_last[wheel_direction])) < abs(encoder_delta(pos[j], enc_last[wheel_direction]))) j = i;
+            result = pos[j];
+        }
+        enc_last[wheel_direction]    = result;
+        enc_os_valid[wheel_direction]   = 1;
+
+        //기록용으로 중앙값에 가장 가까운 원본 프레임 선택
+        for(i=1, j=0; i<n; i++)
+            if(abs(encoder_delta(pos[i], result)) < abs(encoder_delta(pos[j], result))) j = i;
+        best    = frame[j];
+        frec_note_encoder(wheel_direction, &buf[best*3], result);
+    }
+    else
+        result = enc_last[wheel_direction];
+
+    //기록한 원본 프레임(유효 프레임이 없으면 첫 프레임)의 상태 비트와 parity (encoder_read()와 같은 인자)
+    raw = buf[best*3] << 16 | buf[best*3+1] << 8 | buf[best*3+2];
+    MOTOR_TRACE6(enc_read, wheel_direction, raw, result, (raw >> 5) & 0x003f, !__builtin_parity((raw >> 5) & 0x0003ffff), ret);
+    MOTOR_TRACE4(enc_os, wheel_direction, k, n, conf);
+
+#ifdef E_DEBUG
+    printf("oversample %d frames, valid %d, agree %d, confidence %d, pos %x\n", k, n, agree, conf, result);
+#endif
+
+    if(confidence) *confidence = conf;
+    return result;
+}
+
+/*
+* 제어기 엔코더 oversampling 설정 함수
+* int motor_set_oversample(int budget_us)
+* 입력 값 : budget_us ==> 제어 tick 당 바퀴별 엔코더 읽기에 허용할 버스 시간 (us), 0 이면 사용 안함
+* 반환 값 : 성공 0 / 실패 -1
+* 설명 : pos_control(), vel_control(), sync_control()이 encoder_read() 대신 encoder_read_os()를 사용함.
+*       budget 은 (제어 주기 - 제어 연산, DAC 출력 시간)에서 바퀴 수로 나눈 정도로 설정할 것.
+*/
+int motor_set_oversample(int budget_us)
+{
+    if(budget_us < 0) return -1;
+
+    enc_os_budget_us = budget_us;
+    return 0;
+}
+
+/*
+* 엔코더 초기값 설정 함수
+* int encoder_seed(int wheel_direction)
+* 입력 값 : wheel_direction ==> LEFT_WHEEL / RIGHT_WHEEL
+* 반환 값 : 성공 0 / 실패 -1
+* 설명 : 유효한 프레임을 읽을 때까지(최대 ENC_SEED_TRY 번, 1ms 간격) 읽어 마지막 유효 값을 초기화.
+*       첫 유효 프레임 전에는 마지막 유효 값이 0 이므로 첫 변화량이 튀는 것을 막음.
+*       엔코더 spi 설정(및 motor_set_spi()) 이후, 제어 시작 전에 호출할 것.
+*/
+int encoder_seed(int wheel_direction)
+{
+    unsigned char buf[3];
+    unsigned short pos = 0;
+    int i;
+
+    if( (wheel_direction != LEFT_WHEEL) & (wheel_direction != RIGHT_WHEEL) )    return -1;
+
+    for(i=0; i<ENC_SEED_TRY; i++){
+        memset(buf, 0, sizeof(buf));
+        if( (rpi_spi_transfer(motor_enc_ch[wheel_direction], buf, 3, 1) > 0) && (encoder_decode(buf, &pos, NULL) == 0) ){
+            enc_last[wheel_direction]       = pos;
+            enc_os_valid[wheel_direction]   = 1;
+            return 0;
+        }
+        usleep(1000);
+    }
+    return -1;
+}
+
+/*
+* 제어기에서 사용하는 엔코더 읽기 (oversampling 설정에 따라 선택)
+* 반환 값 : 측정 값으로 사용 가능 0 / 사용 불가 -1 (무효한 프레임 또는 신뢰도 ENC_CONF_HIGH 가 아님, pos 는 마지막 유효 값)
+*/
+static int encoder_feedback(int wheel_direction, unsigned short *pos)
+{
+    int conf = ENC_CONF_NONE;
+
+    if(enc_os_budget_us <= 0) return encoder_read_checked(wheel_direction, pos);
+
+    *pos = encoder_read_os(wheel_direction, enc_os_budget_us, &conf);
+    return (conf == ENC_CONF_HIGH) ? 0 : -1;
+}
+
+/*
+* 엔코더 변화량 계산 함수
+* int encoder_delta(unsigned short cur_encoder, unsigned short prev_encoder)
+* 입력 값 : cur_encoder ==> 현재 엔코더 값
+*         prev_encoder ==> 이전 엔코더 값
+* 반환 값 : 부호 있는 엔코더 변화량 (-2048 ~ 2047)
+* 설명 : 0xfff <--> 0x000 경계를 넘는 경우에도 가장 짧은 쪽으로의 변화량을 반환.
+*       1 tick 동안 반 바퀴 이상 회전하지 않는다고 가정.
+*/
+int encoder_delta(unsigned short cur_encoder, unsigned short prev_encoder)
+{
+    int diff = (int)cur_encoder - (int)prev_encoder;
+
+    if(diff > (UNIT_ENCODER_RESOLUTION + 1) / 2)        diff -= UNIT_ENCODER_RESOLUTION + 1;
+    else if(diff < -(UNIT_ENCODER_RESOLUTION + 1) / 2)  diff += UNIT_ENCODER_RESOLUTION + 1;
+    return diff;
 }
 
 /*
@@ -185,6 +551,80 @@ unsigned short encoder_read(int wheel_direction)
 *********************************************************************************************************
 */
 
+/*
+* 제어 출력 가진 신호 설정 함수
+* int motor_set_inject(int wheel_direction, float du)
+* 입력 값 : wheel_direction ==> LEFT_WHEEL / RIGHT_WHEEL
+*         du ==> 다음 제어 tick 부터 제어기 출력에 더해질 값 (DAC 제어량, 보상 전)
+* 반환 값 : 성공 0 / 실패 -1
+* 설명 : 적분기 상태에는 포함되지 않음. 사용 후 0으로 되돌릴 것.
+*/
+int motor_set_inject(int wheel_direction, float du)
+{
+    if( (wheel_direction != LEFT_WHEEL) & (wheel_direction != RIGHT_WHEEL) )    return -1;
+
+    ctrl_inject[wheel_direction] = du;
+    return 0;
+}
+
+/*
+* 마지막 제어 tick의 제어기 출력/측정 속도 읽기 함수
+* int motor_get_output(int wheel_direction, float *u, float *vel)
+* 입력 값 : wheel_direction ==> LEFT_WHEEL / RIGHT_WHEEL
+*         u ==> 제어기 출력 (가진 신호, 보상 제외)
+*         vel ==> 측정 속도 (degree/sec)
+* 반환 값 : 성공 0 / 실패 -1
+*/
+int motor_get_output(int wheel_direction, float *u, float *vel)
+{
+    if( (wheel_direction != LEFT_WHEEL) & (wheel_direction != RIGHT_WHEEL) )    return -1;
+
+    if(u)   *u   = ctrl_u[wheel_direction];
+    if(vel) *vel = ctrl_vel[wheel_direction];
+    return 0;
+}
+
+/*
+* 제어 주기 설정/읽기 함수
+* int motor_set_period(float period)
+* float motor_get_period(void)
+* 입력 값 : period ==> 다음 제어 tick 까지의 시간 (sec)
+* 반환 값 : 성공 0 / 실패 -1
+* 설명 : 제어기는 속도 계산과 적분에 이 값을 사용하므로 루프 주기를 바꾸면 함께 설정할 것 (rate_mgr.c).
+*       축별 스레드(axis_rt.c)는 고정 주기 dT 로 동작하므로 함께 사용하지 않음.
+*/
+int motor_set_period(float period)
+{
+    if(period <= 0) return -1;
+
+    ctrl_dT = period;
+    return 0;
+}
+
+float motor_get_period(void)
+{
+    return ctrl_dT;
+}
+
+/*
+* 바퀴 상태 읽기 함수
+* int motor_get_state(int wheel_direction, float *err, int *brake, int *mode)
+* 입력 값 : wheel_direction ==> LEFT_WHEEL / RIGHT_WHEEL
+*         err ==> 직전 제어 tick 의 오차 (mode 에 따라 pos : degree, vel : degree/sec)
+*         brake ==> BREAK_ON / BREAK_OFF
+*         mode ==> 직전 제어 tick 의 제어기 GS_CTRL_POS(pos_control(), sync_control()) / GS_CTRL_VEL(vel_control())
+* 반환 값 : 성공 0 / 실패 -1
+*/
+int motor_get_state(int wheel_direction, float *err, int *brake, int *mode)
+{
+    if( (wheel_direction != LEFT_WHEEL) & (wheel_direction != RIGHT_WHEEL) )    return -1;
+
+    if(err)     *err    = ctrl_err[wheel_direction];
+    if(brake)   *brake  = motor_brake[wheel_direction];
+    if(mode)    *mode   = ctrl_mode[wheel_direction];
+    return 0;
+}
+
 /*
 * 위치 PI제어 함수 (임시로 작성됨)
 * 해당 함수는 Kist 제공된 코드에 임의로 맞춰 작성된 함수임.
@@ -201,70 +641,103 @@ unsigned short encoder_read(int wheel_direction)
 int pos_control(int ref_pos, int wheel_direction, int move_direction)
 {
     unsigned short cur_encoder=0, err_encoder=0;
-    static unsigned short prev_encoder = 0;
+    static unsigned short prev_encoder[2] = {0,};
 
-    float err_pos = 0, input_dac = 0;
-    static float feedback_pos = 0, err_pos_i = 0;
+    unsigned short dac_word = 0;
+    float err_pos = 0, input_dac = 0, feedback_vel = 0, fwd_vel = 0;
+    static float feedback_pos[2] = {0,}, err_pos_i[2] = {0,};
+    struct gs_gain gain;
+    static struct gs_gain gain_ref[2] = {{Kp, Ki}, {Kp, Ki}};    // 마지막 bumpless 보정 시점 게인
 
     int mv_direction = move_direction;
-    static int i=1;
+    static int i[2]={1,1};
+
+    if( (wheel_direction != LEFT_WHEEL) & (wheel_direction != RIGHT_WHEEL) )    return -1;
 
     //함수 실행시 1번만 실행.
-    while(i){
-        prev_encoder = encoder_read(wheel_direction);   // 해당 함수 실행시 초기 err_encoder값을 0으로 하기 위함. 
+    while(i[wheel_direction]){
+        encoder_feedback(wheel_direction, &prev_encoder[wheel_direction]);   // 해당 함수 실행시 초기 err_encoder값을 0으로 하기 위함. 
         set_direction(wheel_direction,mv_direction);  // 모터 방향 설정
-        i=0;    
+        i[wheel_direction]=0;    
     }
 
-    //절대 엔코더 값 읽기
-    cur_encoder = encoder_read(wheel_direction);
+    //절대 엔코더 값 읽기. 사용할 수 없는 값이면 이번 tick 은 위치, 적분을 갱신하지 않고 직전 DAC 출력 유지
+    //(계속되면 writeDAC()가 멈추므로 비상 정지 watchdog 이 정지시킴)
+    if(encoder_feedback(wheel_direction, &cur_encoder) < 0){
+        ctrl_hold[wheel_direction]++;
+        return (int)ctrl_err[wheel_direction];
+    }
+
+    //FORWARD 기준 부호 있는 속도 (마찰 보상에서 역회전, 외력에 의한 회전 판단용)
+    fwd_vel = (float)encoder_delta(cur_encoder, prev_encoder[wheel_direction]) * ENC_SIGN(wheel_direction)\
+              * 360 / UNIT_ENCODER_RESOLUTION / GEAR_RATIO / (ctrl_dT * (ctrl_hold[wheel_direction] + 1));
 
     //check_over_under_flow 
     //-방향으로 진행시 엔코더의 값이 0xfff --> 0x000으로 엔코더 초기화
     //+방향으로 진행시 엔코더의 값이 0x000 --> 0xfff으로 엔코더 초기화의 경우 연산.
     //ex. -방향 진행시 prev_enc = 0xff0 --> cur_enc = 0x001 일경우 (0x001 + 0xfff) - 0xff0 = 0x011 만큼의 변화가 일어남.
-    if( (mv_direction == BACKWARD) & (prev_encoder > cur_encoder + ENCODER_ERR) )              
+    if( (mv_direction == BACKWARD) & (prev_encoder[wheel_direction] > cur_encoder + ENCODER_ERR) )              
         cur_encoder += UNIT_ENCODER_RESOLUTION;
-    else if( (mv_direction == FORWARD) & (cur_encoder > prev_encoder + ENCODER_ERR) )        
-        prev_encoder += UNIT_ENCODER_RESOLUTION;
+    else if( (mv_direction == FORWARD) & (cur_encoder > prev_encoder[wheel_direction] + ENCODER_ERR) )        
+        prev_encoder[wheel_direction] += UNIT_ENCODER_RESOLUTION;
 
     //unsigned value로 err_encoder 사용.
     //err_encoder = abs(cur_encoder - prev_encoder);    
-    if(cur_encoder>prev_encoder)             err_encoder = cur_encoder - prev_encoder;
-    else if(prev_encoder>cur_encoder)        err_encoder = prev_encoder - cur_encoder;
+    if(cur_encoder>prev_encoder[wheel_direction])             err_encoder = cur_encoder - prev_encoder[wheel_direction];
+    else if(prev_encoder[wheel_direction]>cur_encoder)        err_encoder = prev_encoder[wheel_direction] - cur_encoder;
 
     //prev_encoder값 갱신    
     if(cur_encoder > UNIT_ENCODER_RESOLUTION) cur_encoder -= UNIT_ENCODER_RESOLUTION;
-    prev_encoder = cur_encoder;
+    prev_encoder[wheel_direction] = cur_encoder;
 
     //현재 이동 거리(degree) += 엔코더 에러 * 360 / encoder resoultion / gear ratio
-    feedback_pos += (float)err_encoder * 360 / UNIT_ENCODER_RESOLUTION / GEAR_RATIO; 
+    feedback_pos[wheel_direction] += (float)err_encoder * 360 / UNIT_ENCODER_RESOLUTION / GEAR_RATIO; 
+    feedback_vel = (float)err_encoder * 360 / UNIT_ENCODER_RESOLUTION / GEAR_RATIO / (ctrl_dT * (ctrl_hold[wheel_direction] + 1)); 
+    ctrl_hold[wheel_direction] = 0;
 
     //오차 계산
-    err_pos = ref_pos - feedback_pos;
-    err_pos_i += err_pos * dT;
+    err_pos = ref_pos - feedback_pos[wheel_direction];
+
+    //gain scheduling (게인이 크게 바뀌면 출력이 연속이 되도록 적분 상태 보정)
+    gs_lookup(wheel_direction, GS_CTRL_POS, feedback_vel, err_pos, ctrl_dac[wheel_direction], &gain);
+    err_pos_i[wheel_direction] = gs_bumpless(err_pos_i[wheel_direction], err_pos, &gain_ref[wheel_direction], &gain);
+
+    err_pos_i[wheel_direction] += err_pos * ctrl_dT;
+    ctrl_err[wheel_direction]   = err_pos;
+    ctrl_mode[wheel_direction]  = GS_CTRL_POS;
     if(err_pos < 0){
         mv_direction = (mv_direction == FORWARD) ? BACKWARD : FORWARD;
         set_direction(wheel_direction,mv_direction);
     }
 
     //PI 제어기 
-    input_dac = Kp*err_pos + Ki*err_pos_i;
+    input_dac = gain.kp*err_pos + gain.ki*err_pos_i[wheel_direction];
 
-    //제어입력 DAC로 보내기 
+    ctrl_u[wheel_direction]     = input_dac;
+    ctrl_vel[wheel_direction]   = feedback_vel;
+
+    //데드존/마찰 보상 후 제어입력 DAC로 보내기 (속도는 모터 방향 기준)
+    dac_word = comp_output(wheel_direction, mv_direction, input_dac + ctrl_inject[wheel_direction],\
+                           (mv_direction == FORWARD) ? fwd_vel : -fwd_vel);
+    ctrl_dac[wheel_direction] = dac_word;
     if(wheel_direction == LEFT_WHEEL)
-        writeDAC(DAC_ADDR_LEFT, DAC_CMD_WRUP, (unsigned short)input_dac);
+        writeDAC(DAC_ADDR_LEFT, DAC_CMD_WRUP, dac_word);
     else if(wheel_direction == RIGHT_WHEEL)
-        writeDAC(DAC_ADDR_RIGHT, DAC_CMD_WRUP, (unsigned short)input_dac); 
+        writeDAC(DAC_ADDR_RIGHT, DAC_CMD_WRUP, dac_word); 
+
+    frec_commit(wheel_direction, FREC_TYPE_POS, feedback_pos[wheel_direction], err_pos, err_pos_i[wheel_direction]);
+    MOTOR_TRACE6(ctrl_tick, TRACE_CTRL_POS, wheel_direction, ref_pos, (int)(feedback_pos[wheel_direction] * 1000),\
+                            (int)(err_pos * 1000), dac_word);
 
 //현재 PI 제어의 샘플링은 1ms인데 printf문은 block function이므로 사용하지 않기를 권함.
 //반드시 사용해야할 경우 100ms 샘플링이상에서 사용을 권함. 하지만 이때는 샘플링 부족으로 err_encoder값을 보장할 수 없음.
 #ifdef PI_DEBUG 
     printf("cur_encoder : 0x%x \t",cur_encoder);
     printf("err_encoder : 0x%x \t",err_encoder);
-    printf("feedback_pos: %.2f \t",feedback_pos);
-    printf("err_pos: %.2f \terr_pos_i: %.2f\t",err_pos,err_pos_i);
-    printf("input_dac: 0x%x \n",(unsigned short)input_dac);
+    printf("feedback_pos: %.2f \t",feedback_pos[wheel_direction]);
+    printf("err_pos: %.2f \terr_pos_i: %.2f\t",err_pos,err_pos_i[wheel_direction]);
+    printf("input_dac: 0x%x \t",(unsigned short)input_dac);
+    printf("dac_word: 0x%x \n",dac_word);
 #endif
     return (int)err_pos;
 }
@@ -286,57 +759,86 @@ int pos_control(int ref_pos, int wheel_direction, int move_direction)
 int vel_control(int ref_vel, int wheel_direction, int move_direction)
 {
     unsigned short cur_encoder=0, err_encoder=0;
-    static unsigned short prev_encoder = 0;
+    static unsigned short prev_encoder[2] = {0,};
 
-    float feedback_vel = 0, err_vel = 0;
-    static float err_vel_i = 0, input_dac = 0;
+    unsigned short dac_word = 0;
+    float feedback_vel = 0, err_vel = 0, fwd_vel = 0;
+    static float err_vel_i[2] = {0,}, input_dac[2] = {0,};
+    struct gs_gain gain;
 
     int mv_direction = move_direction;
-    static int i=1;
+    static int i[2]={1,1};
+
+    if( (wheel_direction != LEFT_WHEEL) & (wheel_direction != RIGHT_WHEEL) )    return -1;
 
     //함수 실행시 1번만 실행.
-    while(i){
-        prev_encoder = encoder_read(wheel_direction);   // 해당 함수 실행시 초기 err_encoder값을 0으로 하기 위함. 
+    while(i[wheel_direction]){
+        encoder_feedback(wheel_direction, &prev_encoder[wheel_direction]);   // 해당 함수 실행시 초기 err_encoder값을 0으로 하기 위함. 
         set_direction(wheel_direction,mv_direction);  // 모터 방향 설정
-        i=0;    
+        i[wheel_direction]=0;    
     }
 
-    //절대 엔코더 값 읽기
-    cur_encoder = encoder_read(wheel_direction);
+    //절대 엔코더 값 읽기. 사용할 수 없는 값이면 이번 tick 은 위치, 적분을 갱신하지 않고 직전 DAC 출력 유지
+    //(계속되면 writeDAC()가 멈추므로 비상 정지 watchdog 이 정지시킴)
+    if(encoder_feedback(wheel_direction, &cur_encoder) < 0){
+        ctrl_hold[wheel_direction]++;
+        return (int)ctrl_err[wheel_direction];
+    }
+
+    //FORWARD 기준 부호 있는 속도 (마찰 보상에서 역회전, 외력에 의한 회전 판단용)
+    fwd_vel = (float)encoder_delta(cur_encoder, prev_encoder[wheel_direction]) * ENC_SIGN(wheel_direction)\
+              * 360 / UNIT_ENCODER_RESOLUTION / GEAR_RATIO / (ctrl_dT * (ctrl_hold[wheel_direction] + 1));
 
     //check_over_under_flow 
     //-방향으로 진행시 엔코더의 값이 0xfff --> 0x000으로 엔코더 초기화
     //+방향으로 진행시 엔코더의 값이 0x000 --> 0xfff으로 엔코더 초기화의 경우 연산.
     //ex. -방향 진행시 prev_enc = 0xff0 --> cur_enc = 0x001 일경우 (0x001 + 0xfff) - 0xff0 = 0x011 만큼의 변화가 일어남.
-    if( (mv_direction == BACKWARD) & (prev_encoder > cur_encoder + ENCODER_ERR) )              
+    if( (mv_direction == BACKWARD) & (prev_encoder[wheel_direction] > cur_encoder + ENCODER_ERR) )              
         cur_encoder += UNIT_ENCODER_RESOLUTION;
-    else if( (mv_direction == FORWARD) & (cur_encoder > prev_encoder + ENCODER_ERR) )        
-        prev_encoder += UNIT_ENCODER_RESOLUTION;
+    else if( (mv_direction == FORWARD) & (cur_encoder > prev_encoder[wheel_direction] + ENCODER_ERR) )        
+        prev_encoder[wheel_direction] += UNIT_ENCODER_RESOLUTION;
 
     //unsigned value로 err_encoder 사용.
     //err_encoder = abs(cur_encoder - prev_encoder);    
-    if(cur_encoder>prev_encoder)             err_encoder = cur_encoder - prev_encoder;
-    else if(prev_encoder>cur_encoder)        err_encoder = prev_encoder - cur_encoder;
+    if(cur_encoder>prev_encoder[wheel_direction])             err_encoder = cur_encoder - prev_encoder[wheel_direction];
+    else if(prev_encoder[wheel_direction]>cur_encoder)        err_encoder = prev_encoder[wheel_direction] - cur_encoder;
     
     //prev_encoder값 갱신        
     if(cur_encoder > UNIT_ENCODER_RESOLUTION) cur_encoder -= UNIT_ENCODER_RESOLUTION;    
-    prev_encoder = cur_encoder;
+    prev_encoder[wheel_direction] = cur_encoder;
 
     //순간속도 = (enc * 360 / 4095(Resoultion) / 6.3(Gear ratio)) / 0.001(dT)
-    feedback_vel = (float)err_encoder * 360 / UNIT_ENCODER_RESOLUTION / GEAR_RATIO / dT; 
+    feedback_vel = (float)err_encoder * 360 / UNIT_ENCODER_RESOLUTION / GEAR_RATIO / (ctrl_dT * (ctrl_hold[wheel_direction] + 1)); 
+    ctrl_hold[wheel_direction] = 0;
 
     //속도 오차 계산
     err_vel = ref_vel - feedback_vel;
-    err_vel_i += err_vel * dT;
 
-    //PI 제어기 
-    input_dac += Kp*err_vel + Ki*err_vel_i;
+    //gain scheduling (누적 형태이므로 게인이 바뀌어도 출력이 튀지 않음, 적분 상태 보정 없음)
+    gs_lookup(wheel_direction, GS_CTRL_VEL, feedback_vel, err_vel, ctrl_dac[wheel_direction], &gain);
+
+    err_vel_i[wheel_direction] += err_vel * ctrl_dT;
+    ctrl_err[wheel_direction]   = err_vel;
+    ctrl_mode[wheel_direction]  = GS_CTRL_VEL;
+
+    //PI 제어기 (누적 형태이므로 주기가 dT 와 다르면 증분을 주기에 비례하여 보정)
+    input_dac[wheel_direction] += (gain.kp*err_vel + gain.ki*err_vel_i[wheel_direction]) * (ctrl_dT / dT);
 
-    //제어입력 DAC로 보내기 
+    ctrl_u[wheel_direction]     = input_dac[wheel_direction];
+    ctrl_vel[wheel_direction]   = feedback_vel;
+
+    //데드존/마찰 보상 후 제어입력 DAC로 보내기 (속도는 모터 방향 기준)
+    dac_word = comp_output(wheel_direction, mv_direction, input_dac[wheel_direction] + ctrl_inject[wheel_direction],\
+                           (mv_direction == FORWARD) ? fwd_vel : -fwd_vel);
+    ctrl_dac[wheel_direction] = dac_word;
     if(wheel_direction == LEFT_WHEEL)
-        writeDAC(DAC_ADDR_LEFT, DAC_CMD_WRUP, (unsigned short)input_dac);
+        writeDAC(DAC_ADDR_LEFT, DAC_CMD_WRUP, dac_word);
     else if(wheel_direction == RIGHT_WHEEL)
-        writeDAC(DAC_ADDR_RIGHT, DAC_CMD_WRUP, (unsigned short)input_dac); 
+        writeDAC(DAC_ADDR_RIGHT, DAC_CMD_WRUP, dac_word); 
+
+    frec_commit(wheel_direction, FREC_TYPE_VEL, feedback_vel, err_vel, err_vel_i[wheel_direction]);
+    MOTOR_TRACE6(ctrl_tick, TRACE_CTRL_VEL, wheel_direction, ref_vel, (int)(feedback_vel * 1000),\
+                            (int)(err_vel * 1000), dac_word);
 
 //현재 PI 제어의 샘플링은 1ms인데 printf문은 block function이므로 사용하지 않기를 권함.
 //반드시 사용해야할 경우 100ms 샘플링이상에서 사용을 권함. 하지만 이때는 샘플링 부족으로 err_encoder값을 보장할 수 없음.
@@ -344,13 +846,144 @@ int vel_control(int ref_vel, int wheel_direction, int move_direction)
     printf("cur_encoder : %d \t",cur_encoder);
     printf("err_encoder : %d \t",err_encoder);
     printf("feedback_vel : %.2f \t",feedback_vel);
-    printf("err_vel: %.2f \terr_vel_i: %.2f\t",err_vel,err_vel_i);
-    printf("input_dac: %x \n",(unsigned short)input_dac);
+    printf("err_vel: %.2f \terr_vel_i: %.2f\t",err_vel,err_vel_i[wheel_direction]);
+    printf("input_dac: %x \t",(unsigned short)input_dac[wheel_direction]);
+    printf("dac_word: %x \n",dac_word);
 #endif
     return (int)err_vel;
 }
 
 
+/*
+* 두 바퀴 동기 위치 PI제어 함수 (Cross-coupled control)
+* 두 바퀴를 각각 독립된 PI제어로 움직이면 부하/모터 편차로 인해 로봇이 휘게 되므로 
+* 매 tick 마다 좌/우 진행량의 비율 오차(동기 오차)를 계산하여 양쪽 제어 입력에 서로 반대로 더해 줌.
+*   sync_err = ratio * 왼쪽 진행량 - 오른쪽 진행량
+*   왼쪽 입력 -= SYNC_Kc * sync_err + SYNC_Ki * sync_err_i
+*   오른쪽 입력 += SYNC_Kc * sync_err + SYNC_Ki * sync_err_i
+* 두 채널은 Input Register에 먼저 쓴 후 DAC_CMD_WRUP_ALL 로 한번에 갱신되어 동시에 출력됨.
+* 바퀴별 DAC가 다른 spi 채널에 연결된 경우(motor_set_spi())에는 각각 갱신함.
+* int sync_control(int ref_pos, int move_direction, float ratio)
+* 입력 값 : ref_pos ==> 왼쪽 바퀴의 원하는 이동 각도 (오른쪽은 ref_pos * ratio)
+*         move_direction ==> FORWARD / BACKWARD
+*         ratio ==> 오른쪽/왼쪽 이동 비율. 직진 1.0, 원호 주행시 (오른쪽 반지름 / 왼쪽 반지름)
+* 반환 값 : 동기 오차 값
+*/
+int sync_control(int ref_pos, int move_direction, float ratio)
+{
+    unsigned short cur_encoder=0, cur[2]={0,}, dac_word[2]={0,};
+    static unsigned short prev_encoder[2] = {0,};
+
+    float err_pos[2] = {0,}, input_dac[2] = {0,}, feedback_vel[2] = {0,}, ref[2] = {0,};
+    float sync_err = 0, sync_u = 0;
+    static float feedback_pos[2] = {0,}, err_pos_i[2] = {0,}, sync_err_i = 0, sync_err_prev = 0;
+    struct gs_gain gain[2];
+    static struct gs_gain gain_ref[2] = {{Kp, Ki}, {Kp, Ki}};    // 마지막 bumpless 보정 시점 게인
+
+    static int mv_direction[2] = {0,};
+    int wheel = 0, diff = 0;
+    static int i=1;
+
+    //함수 실행시 1번만 실행.
+    while(i){
+        for(wheel=RIGHT_WHEEL; wheel<=LEFT_WHEEL; wheel++){
+            encoder_feedback(wheel, &prev_encoder[wheel]);
+            mv_direction[wheel] = move_direction;
+            set_direction(wheel,move_direction);
+        }
+        i=0;
+    }
+
+    ref[LEFT_WHEEL]     = ref_pos;
+    ref[RIGHT_WHEEL]    = ref_pos * ratio;
+
+    //두 바퀴 중 하나라도 엔코더 값을 사용할 수 없으면 이번 tick 은 갱신하지 않고 직전 DAC 출력 유지
+    for(wheel=RIGHT_WHEEL, diff=0; wheel<=LEFT_WHEEL; wheel++)
+        diff |= encoder_feedback(wheel, &cur[wheel]);
+    if(diff < 0){
+        ctrl_hold[RIGHT_WHEEL]++;
+        ctrl_hold[LEFT_WHEEL]++;
+        return (int)sync_err_prev;
+    }
+
+    for(wheel=RIGHT_WHEEL; wheel<=LEFT_WHEEL; wheel++){
+        //부호 있는 변화량을 장착 방향으로 FORWARD 기준으로 바꾸고 진행 방향(move_direction) 기준 진행량으로 변환.
+        //(명령된 모터 방향과 무관하므로 방향 전환 후 관성 회전, 부하에 의한 역회전도 실제 방향으로 반영됨)
+        cur_encoder = cur[wheel];
+        diff = encoder_delta(cur_encoder, prev_encoder[wheel]) * ENC_SIGN(wheel);
+        if(move_direction == BACKWARD) diff = -diff;
+        prev_encoder[wheel] = cur_encoder;
+
+        feedback_pos[wheel] += (float)diff * 360 / UNIT_ENCODER_RESOLUTION / GEAR_RATIO;
+        feedback_vel[wheel]  = (float)diff * 360 / UNIT_ENCODER_RESOLUTION / GEAR_RATIO / (ctrl_dT * (ctrl_hold[wheel] + 1));
+        ctrl_hold[wheel]     = 0;
+
+        err_pos[wheel]      = ref[wheel] - feedback_pos[wheel];
+
+        //gain scheduling (게인이 크게 바뀌면 출력이 연속이 되도록 적분 상태 보정)
+        gs_lookup(wheel, GS_CTRL_POS, feedback_vel[wheel], err_pos[wheel], ctrl_dac[wheel], &gain[wheel]);
+        err_pos_i[wheel]    = gs_bumpless(err_pos_i[wheel], err_pos[wheel], &gain_ref[wheel], &gain[wheel]);
+
+        err_pos_i[wheel]   += err_pos[wheel] * ctrl_dT;
+        ctrl_err[wheel]     = err_pos[wheel];
+        ctrl_mode[wheel]    = GS_CTRL_POS;
+    }
+
+    //동기 오차 계산 (오른쪽 기준으로 정규화)
+    sync_err    = ratio * feedback_pos[LEFT_WHEEL] - feedback_pos[RIGHT_WHEEL];
+    sync_err_i += sync_err * ctrl_dT;
+    sync_u      = SYNC_Kc * sync_err + SYNC_Ki * sync_err_i;
+    sync_err_prev = sync_err;
+
+    //PI 제어기 + 교차 결합 보정
+    input_dac[LEFT_WHEEL]   = gain[LEFT_WHEEL].kp*err_pos[LEFT_WHEEL]   + gain[LEFT_WHEEL].ki*err_pos_i[LEFT_WHEEL]   - sync_u;
+    input_dac[RIGHT_WHEEL]  = gain[RIGHT_WHEEL].kp*err_pos[RIGHT_WHEEL] + gain[RIGHT_WHEEL].ki*err_pos_i[RIGHT_WHEEL] + sync_u;
+
+    for(wheel=RIGHT_WHEEL; wheel<=LEFT_WHEEL; wheel++){
+        //제어 입력의 부호에 따라 방향 설정
+        if( (input_dac[wheel] < 0) & (mv_direction[wheel] == move_direction) ){
+            mv_direction[wheel] = (move_direction == FORWARD) ? BACKWARD : FORWARD;
+            set_direction(wheel,mv_direction[wheel]);
+        }
+        else if( (input_dac[wheel] >= 0) & (mv_direction[wheel] != move_direction) ){
+            mv_direction[wheel] = move_direction;
+            set_direction(wheel,mv_direction[wheel]);
+        }
+        ctrl_u[wheel]   = input_dac[wheel];
+        ctrl_vel[wheel] = feedback_vel[wheel];
+        //feedback_vel 은 move_direction 기준이므로 모터 방향 기준으로 바꿔 전달
+        dac_word[wheel] = comp_output(wheel, mv_direction[wheel], input_dac[wheel] + ctrl_inject[wheel],\
+                                      (mv_direction[wheel] == move_direction) ? feedback_vel[wheel] : -feedback_vel[wheel]);
+        ctrl_dac[wheel] = dac_word[wheel];
+    }
+
+    //Input Register에 왼쪽 값을 쓰고, 오른쪽 값을 쓰면서 두 채널 동시 갱신
+    //바퀴별 DAC가 다른 spi 채널에 있으면 각각 갱신
+    if(motor_dac_shared()){
+        writeDAC(DAC_ADDR_LEFT, DAC_CMD_WR_REG, dac_word[LEFT_WHEEL]);
+        writeDAC(DAC_ADDR_RIGHT, DAC_CMD_WRUP_ALL, dac_word[RIGHT_WHEEL]);
+    }
+    else{
+        writeDAC(DAC_ADDR_LEFT, DAC_CMD_WRUP, dac_word[LEFT_WHEEL]);
+        writeDAC(DAC_ADDR_RIGHT, DAC_CMD_WRUP, dac_word[RIGHT_WHEEL]);
+    }
+
+    for(wheel=RIGHT_WHEEL; wheel<=LEFT_WHEEL; wheel++){
+        frec_commit(wheel, FREC_TYPE_SYNC, feedback_pos[wheel], err_pos[wheel], err_pos_i[wheel]);
+        MOTOR_TRACE6(ctrl_tick, TRACE_CTRL_SYNC, wheel, (int)ref[wheel], (int)(feedback_pos[wheel] * 1000),\
+                                (int)(err_pos[wheel] * 1000), dac_word[wheel]);
+    }
+
+#ifdef PI_DEBUG 
+    printf("pos L: %.2f R: %.2f \t",feedback_pos[LEFT_WHEEL],feedback_pos[RIGHT_WHEEL]);
+    printf("err L: %.2f R: %.2f \t",err_pos[LEFT_WHEEL],err_pos[RIGHT_WHEEL]);
+    printf("sync_err: %.2f \tsync_u: %.2f\t",sync_err,sync_u);
+    printf("dac_word L: 0x%x R: 0x%x \n",dac_word[LEFT_WHEEL],dac_word[RIGHT_WHEEL]);
+#endif
+    return (int)sync_err;
+}
+
+
 /*
 * 테스트용 함수. 
 * DAC에 써준 값에 의해 돌아가는 중 엔코더 값을 읽어와 데이터 표기
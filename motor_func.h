@@ -10,10 +10,11 @@
 * M_DEBUG DAC 관련 정보 print
 * E_DEBUG Encdoer 관련 정보 print
 * PI_DEBUG PI제어 관련 정보 printf (사용 하지 않길 권장).
+* 모두 제어 tick 마다 printf 하므로 기본은 꺼져 있음. 제어 tick 관찰은 tracepoint(motor_trace.h) 사용.
 */
-#define M_DEBUG
-#define E_DEBUG
-#define PI_DEBUG
+//#define M_DEBUG
+//#define E_DEBUG
+//#define PI_DEBUG
 
 /*
 *********************************************************************************************************
@@ -86,8 +87,42 @@
 //#define RPM_CONST 2.3251488095238095238095238  // 60(min) / RESOULTION / GEAR Ratio / dT	
 #define Kp  3.5 
 #define Ki  0.5
+#define SYNC_Kc 2.0   // 두 바퀴 동기(교차 결합) 제어 비례 이득
+#define SYNC_Ki 0.2   // 두 바퀴 동기(교차 결합) 제어 적분 이득
 #define ENCODER_ERR 0x002 // 엔코더 오차가 0.006 degree이지만 10비트로 표현되므로 임의적으로 1step으로 설정함.
 
+/*
+* 바퀴별 엔코더 장착 방향. FORWARD 로 회전할 때 엔코더 값이 증가하면 1, 감소하면 -1.
+* 현재 보드는 FORWARD 시 엔코더 값이 감소함(pos_control() overflow 처리 주석 참조). 바퀴를 반대로 장착한 경우 변경.
+*/
+#define ENC_SIGN_L  (-1)
+#define ENC_SIGN_R  (-1)
+#define ENC_SIGN(wheel)     (((wheel) == LEFT_WHEEL) ? ENC_SIGN_L : ENC_SIGN_R)
+
+/*
+* 엔코더 oversampling (encoder_read_os())
+* 1 tick 에 K 개의 프레임을 SPI 메시지 1번으로 읽어 검증 후 중앙값을 사용.
+* K 는 프레임 1개의 측정된 버스 시간과 tick 당 허용 버스 시간(budget_us)으로 매 tick 결정됨.
+* 엔코더 SPI 클럭(SPI_ENC_SPEED)이 낮으면 프레임 1개가 budget 을 넘으므로 K = 1 (검증만 수행).
+*/
+#define ENC_OS_MAX      16              // 최대 프레임 수 (SPI_MULTI_MAX 이하)
+#define ENC_OS_AGREE    (ENCODER_ERR*2) // 중앙값과 일치하는 것으로 보는 범위 (step)
+
+// 엔코더 상태 비트 (en_cmd_data)
+#define ENC_ST_OCF      0x20    // Offset Compensation Finished, 1 이어야 유효
+#define ENC_ST_COF      0x10    // CORDIC Overflow, 1 이면 무효
+#define ENC_ST_LIN      0x08    // Linearity Alarm, 1 이면 무효
+#define ENC_ST_MAGINC   0x04
+#define ENC_ST_MAGDEC   0x02    // MagInc, MagDec 모두 1 이면 자기장 범위 초과로 무효
+#define ENC_ST_PARITY   0x01    // Even Parity
+
+// encoder_read_os() 신뢰도
+#define ENC_CONF_NONE   0   // 유효 프레임 없음. 마지막 값 유지
+#define ENC_CONF_LOW    1   // 유효 프레임은 있으나 과반이 일치하지 않음
+#define ENC_CONF_HIGH   2   // 과반의 프레임이 중앙값과 일치
+
+#define ENC_SEED_TRY    100 // encoder_seed() 최대 읽기 횟수 (1ms 간격)
+
 
 /*
 *********************************************************************************************************
@@ -95,11 +130,27 @@
 *********************************************************************************************************
 */
 int motor_hw_init(void);
+int motor_set_spi(int wheel_direction, int dac_channel, int enc_channel);
+int motor_get_spi(int wheel_direction, int *dac_channel, int *enc_channel);
+int motor_dac_shared(void);
+int motor_health(int wheel_direction);
 int brake_wheel(int wheel_direction, int cmd);
 int set_direction(int wheel_direction, int cmd);
 int writeDAC(unsigned char addr, unsigned char cmd, unsigned short data);
 unsigned short encoder_read(int wheel_direction);
+int encoder_read_checked(int wheel_direction, unsigned short *pos);
+int encoder_decode(const unsigned char *raw, unsigned short *pos, unsigned short *status);
+unsigned short encoder_read_os(int wheel_direction, int budget_us, int *confidence);
+int encoder_seed(int wheel_direction);
+int motor_set_oversample(int budget_us);
+int encoder_delta(unsigned short cur_encoder, unsigned short prev_encoder);
+int motor_set_inject(int wheel_direction, float du);
+int motor_get_output(int wheel_direction, float *u, float *vel);
+int motor_set_period(float period);
+float motor_get_period(void);
+int motor_get_state(int wheel_direction, float *err, int *brake, int *mode);
 int pos_control(int ref_pos, int wheel_direction, int move_direction);
 int vel_control(int ref_vel, int wheel_direction, int move_direction);
+int sync_control(int ref_pos, int move_direction, float ratio);
 void pos_speed_printf(int wheel_direction, int move_direction);
 #endif
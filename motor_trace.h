@@ -0,0 +1,52 @@
+/*
+*********************************************************************************************************
+*                                              MOTOR_TRACE.H
+*********************************************************************************************************
+*/
+#ifndef __MOTOR_TRACE_H__
+#define __MOTOR_TRACE_H__
+
+/*
+*********************************************************************************************************
+*                                      USDT STATIC TRACEPOINTS
+* M_DEBUG/E_DEBUG/PI_DEBUG 의 printf 대신 항상 컴파일되어 있는 정적 tracepoint.
+* <sys/sdt.h> (Raspberry Pi OS : sudo apt install systemtap-sdt-dev) 가 있으면 probe 마다 nop 명령 1개와
+* ELF note 가 생성되며, tracer(bpftrace, perf)가 붙기 전까지는 인자 계산 외에 비용이 없음.
+* 헤더가 없거나 NO_TRACE 가 정의되면 빈 매크로가 됨. (인자는 sizeof 로만 참조하여 계산하지 않고 unused 경고만 막음)
+* provider : raspi_motor
+*   spi_rw_entry    (channel, len)
+*   spi_rw_return   (channel, ret)
+*   spi_retry       (channel, attempt, ret, health)
+*   gpio_write      (pin, status)
+*   dac_write       (addr, cmd, data, ret)
+*   enc_read        (wheel, raw_frame, pos, status, parity_ok, ret)
+*                   encoder_read_os() 에서는 기록한 프레임 1개 기준 (유효 프레임 수는 enc_os)
+*   enc_os          (wheel, frames, valid, confidence)
+*   ctrl_tick       (type, wheel, ref, feedback_milli, err_milli, dac_word)
+* 사용 예는 scripts/ 의 bpftrace, perf 스크립트 참조.
+*********************************************************************************************************
+*/
+#if !defined(NO_TRACE) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define MOTOR_TRACE_ENABLED
+#endif
+#endif
+
+// ctrl_tick type
+#define TRACE_CTRL_POS  1
+#define TRACE_CTRL_VEL  2
+#define TRACE_CTRL_SYNC 3
+
+#ifdef MOTOR_TRACE_ENABLED
+#define MOTOR_TRACE2(name,a1,a2)                    STAP_PROBE2(raspi_motor,name,a1,a2)
+#define MOTOR_TRACE4(name,a1,a2,a3,a4)              STAP_PROBE4(raspi_motor,name,a1,a2,a3,a4)
+#define MOTOR_TRACE6(name,a1,a2,a3,a4,a5,a6)        STAP_PROBE6(raspi_motor,name,a1,a2,a3,a4,a5,a6)
+#else
+#define MOTOR_TRACE_UNUSED(a)                       (void)sizeof(a)
+#define MOTOR_TRACE2(name,a1,a2)                    do{ MOTOR_TRACE_UNUSED(a1); MOTOR_TRACE_UNUSED(a2); }while(0)
+#define MOTOR_TRACE4(name,a1,a2,a3,a4)              do{ MOTOR_TRACE2(name,a1,a2); MOTOR_TRACE2(name,a3,a4); }while(0)
+#define MOTOR_TRACE6(name,a1,a2,a3,a4,a5,a6)        do{ MOTOR_TRACE4(name,a1,a2,a3,a4); MOTOR_TRACE2(name,a5,a6); }while(0)
+#endif
+
+#endif
@@ -0,0 +1,224 @@
+/*
+*********************************************************************************************************
+*                                             RATE_MGR_C
+*********************************************************************************************************
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "motor_func.h"
+#include "gain_sched.h"
+#include "estop.h"
+#include "rate_mgr.h"
+
+/*
+*********************************************************************************************************
+*                                        CONTROL LOOP RATE VARIABLE
+*********************************************************************************************************
+*/
+static int              rate_full_us = RATE_FULL_US;
+static int              rate_idle_us = RATE_IDLE_US;
+static int              rate_idle_ticks = RATE_IDLE_TICKS;
+
+static int              rate_idle = 0;          // 현재 idle 주기 여부
+static int              rate_quiet = 0;         // 연속 정지 tick 수
+static int              rate_started = 0;
+static struct timespec  rate_last;              // 직전 tick 시작 시각 (rate_wait() 반환 시각)
+static struct rate_stat rate_st;
+
+static atomic_int       rate_pending;           // 대기 중인 명령
+static pthread_mutex_t  rate_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   rate_cond;              // rate_init()에서 CLOCK_MONOTONIC 으로 초기화
+static atomic_int       rate_ready;             // rate_cond 초기화 여부
+
+/*
+* 모든 바퀴가 정지 상태인지 확인
+* 브레이크 상태이거나, 1 tick 변화량과 오차가 모두 ENCODER_ERR(degree 환산) 이내이면 정지.
+* 오차는 제어기 종류에 따라 단위가 다르므로 위치 제어는 degree, 속도 제어는 1 tick 동안의 변위(degree/sec * 주기)로 비교.
+*/
+static int rate_quiet_now(void)
+{
+    float step = (float)ENCODER_ERR * 360 / UNIT_ENCODER_RESOLUTION / GEAR_RATIO;
+    float err = 0, vel = 0;
+    int wheel, brake = BREAK_OFF, mode = GS_CTRL_POS;
+
+    for(wheel=RIGHT_WHEEL; wheel<=LEFT_WHEEL; wheel++){
+        motor_get_state(wheel, &err, &brake, &mode);
+        if(brake == BREAK_ON) continue;
+
+        motor_get_output(wheel, NULL, &vel);
+        if(fabsf(vel) * motor_get_period() > step)  return 0;
+        if(mode == GS_CTRL_VEL) err *= motor_get_period();
+        if(fabsf(err) > step)                       return 0;
+    }
+    return 1;
+}
+
+/*
+* 주기 관리 초기화 함수
+* int rate_init(int full_us, int idle_us, int idle_ticks)
+* 입력 값 : full_us ==> 평소 주기 (RATE_FULL_US)
+*         idle_us ==> 정지 상태 주기 (RATE_IDLE_US)
+*         idle_ticks ==> idle 전환 전 정지 상태 유지 tick 수 (RATE_IDLE_TICKS)
+* 반환 값 : 성공 0 / 실패 -1
+* 설명 : idle_us 는 watchdog(ESTOP_WDT_MS)의 절반 이하여야 함.
+*/
+int rate_init(int full_us, int idle_us, int idle_ticks)
+{
+    pthread_condattr_t attr;
+
+    if( (full_us <= 0) | (idle_us < full_us) | (idle_ticks < 1) )  return -1;
+    if(idle_us * 2 > ESTOP_WDT_MS * 1000)                           return -1;
+
+    //condvar 는 1번만 초기화 (다른 스레드가 rate_command()로 사용 중일 수 있음)
+    if(!atomic_load(&rate_ready)){
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&rate_cond, &attr);
+        pthread_condattr_destroy(&attr);
+        atomic_store(&rate_ready, 1);
+    }
+
+    rate_full_us    = full_us;
+    rate_idle_us    = idle_us;
+    rate_idle_ticks = idle_ticks;
+    rate_idle       = 0;
+    rate_quiet      = 0;
+    rate_started    = 0;
+    memset(&rate_st, 0, sizeof(rate_st));
+    atomic_store(&rate_pending, 0);
+
+    motor_set_period(full_us * 1e-6f);
+    return 0;
+}
+
+/*
+* 명령 도착 알림 함수
+* void rate_command(void)
+* 설명 : 다음 tick 부터 full 주기로 동작. idle 주기로 sleep 중이면 즉시 깨움.
+*       다른 스레드에서 호출 가능 (시그널 핸들러에서는 사용하지 않음). rate_init() 전에는 condvar 를 사용하지 않음.
+*/
+void rate_command(void)
+{
+    atomic_store(&rate_pending, 1);
+    if(!atomic_load(&rate_ready)) return;
+
+    pthread_mutex_lock(&rate_lock);
+    pthread_cond_signal(&rate_cond);
+    pthread_mutex_unlock(&rate_lock);
+}
+
+/*
+* 다음 주기 결정 함수 (제어 함수 호출 후 매 tick 호출)
+* int rate_update(struct timespec *deadline)
+* 입력 값 : deadline ==> 다음 tick 시각 (직전 tick 시작 시각 + 주기, CLOCK_MONOTONIC), NULL 가능
+* 반환 값 : 다음 주기 (us)
+* 설명 : 대기는 하지 않음. 이벤트 루프(ctrl_loop.c)에서 timerfd 설정에 사용.
+*/
+int rate_update(struct timespec *deadline)
+{
+    long period;
+    int was_idle = rate_idle;
+
+    if(atomic_exchange(&rate_pending, 0) | !rate_quiet_now()){
+        rate_quiet  = 0;
+        rate_idle   = 0;
+    }
+    else if(rate_quiet < rate_idle_ticks)   rate_quiet++;
+    else                                    rate_idle = 1;
+
+    if(was_idle & !rate_idle) rate_st.wakeups++;
+    if(rate_idle)   rate_st.idle_ticks++;
+    else            rate_st.full_ticks++;
+    period = rate_idle ? rate_idle_us : rate_full_us;
+
+    if(!rate_started){
+        clock_gettime(CLOCK_MONOTONIC, &rate_last);
+        rate_started = 1;
+    }
+    if(deadline){
+        deadline->tv_sec  = rate_last.tv_sec + (rate_last.tv_nsec + period * 1000) / 1000000000L;
+        deadline->tv_nsec = (rate_last.tv_nsec + period * 1000) % 1000000000L;
+    }
+    return (int)period;
+}
+
+/*
+* tick 시작 함수 (제어 함수 호출 직전 매 tick 호출)
+* int rate_mark(void)
+* 입력 값 : 없음
+* 반환 값 : 직전 tick 부터의 실제 경과 시간 (us)
+* 설명 : 실제 경과 시간을 motor_set_period()로 설정하여 이번 제어 tick 의 속도 계산과 적분에 사용.
+*/
+int rate_mark(void)
+{
+    struct timespec now;
+    long elapsed_us;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if(!rate_started){
+        rate_last       = now;
+        rate_started    = 1;
+        return (int)(motor_get_period() * 1e6f);
+    }
+    elapsed_us = (now.tv_sec - rate_last.tv_sec) * 1000000L + (now.tv_nsec - rate_last.tv_nsec) / 1000;
+    rate_last  = now;
+
+    //제어 연산이 주기를 넘거나 너무 일찍 깨어난 경우 제한
+    if(elapsed_us < rate_full_us / 2)   elapsed_us = rate_full_us / 2;
+    if(elapsed_us > rate_idle_us * 2)   elapsed_us = rate_idle_us * 2;
+    motor_set_period(elapsed_us * 1e-6f);
+
+    return (int)elapsed_us;
+}
+
+/*
+* 다음 tick 까지 대기 함수 (제어 함수 호출 후 매 tick 호출)
+* int rate_wait(void)
+* 입력 값 : 없음
+* 반환 값 : 직전 tick 부터의 실제 경과 시간 (us)
+* 설명 : rate_update()로 주기를 정하고, 직전 tick 시작 시각 + 주기까지 대기(명령이 오면 즉시 반환)한 후 rate_mark().
+*/
+int rate_wait(void)
+{
+    struct timespec deadline;
+
+    rate_update(&deadline);
+    if(!atomic_load(&rate_ready)){
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+        return rate_mark();
+    }
+
+    //대기 (명령이 오면 즉시 반환)
+    pthread_mutex_lock(&rate_lock);
+    while(!atomic_load(&rate_pending)){
+        if(pthread_cond_timedwait(&rate_cond, &rate_lock, &deadline) == ETIMEDOUT) break;
+    }
+    pthread_mutex_unlock(&rate_lock);
+
+    return rate_mark();
+}
+
+/*
+* 현재 주기 상태 / 통계 읽기 함수
+* int rate_is_idle(void)                          반환 값 : idle 1 / full 0
+* void rate_get_stat(struct rate_stat *stat)
+*/
+int rate_is_idle(void)
+{
+    return rate_idle;
+}
+
+void rate_get_stat(struct rate_stat *stat)
+{
+    if(stat == NULL) return;
+
+    *stat = rate_st;
+}
@@ -0,0 +1,46 @@
+/*
+*********************************************************************************************************
+*                                              RATE_MGR.H
+*********************************************************************************************************
+*/
+#ifndef __RATE_MGR_H__
+#define __RATE_MGR_H__
+
+#include <time.h>
+
+/*
+*********************************************************************************************************
+*                                        CONTROL LOOP RATE MANAGER
+* spi_pid.c 제어 루프의 주기를 상태에 따라 바꿈.
+*   full : 평소 주기 (RATE_FULL_US, dT)
+*   idle : 모든 바퀴가 브레이크 상태이거나 정지(1 tick 변화량 ENCODER_ERR 이하) + 오차 ENCODER_ERR 이내이고
+*          대기 중인 명령이 없는 상태가 RATE_IDLE_TICKS 동안 유지되면 RATE_IDLE_US 주기로 낮춤.
+* 명령(rate_command())이 들어오거나 엔코더 움직임이 보이면 바로 다음 tick 부터 full 주기로 복귀.
+* idle 중의 sleep 은 rate_command()로 즉시 깨어남.
+* 매 tick 실제 경과 시간을 motor_set_period()로 제어기에 알려 속도 계산과 적분이 주기와 무관하게 연속이 됨.
+* idle 주기는 비상 정지 watchdog(ESTOP_WDT_MS)보다 충분히 짧아야 함.
+*********************************************************************************************************
+*/
+#define RATE_FULL_US        1000    // 1KHz (dT)
+#define RATE_IDLE_US        20000   // 50Hz
+#define RATE_IDLE_TICKS     200     // idle 전환 전 정지 상태 유지 tick 수 (full 주기 기준 200ms)
+
+struct rate_stat {
+    unsigned long   full_ticks;     // full 주기로 동작한 tick 수
+    unsigned long   idle_ticks;     // idle 주기로 동작한 tick 수
+    unsigned long   wakeups;        // idle --> full 전환 횟수
+};
+
+/*
+*********************************************************************************************************
+*                                              PREDEFINE FUNCTION
+*********************************************************************************************************
+*/
+int rate_init(int full_us, int idle_us, int idle_ticks);
+void rate_command(void);
+int rate_update(struct timespec *deadline);
+int rate_mark(void);
+int rate_wait(void);
+int rate_is_idle(void);
+void rate_get_stat(struct rate_stat *stat);
+#endif
@@ -7,11 +7,17 @@
 #include <stdlib.h>
 #include <unistd.h> 
 #include <stdint.h> 
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/mman.h>
 #include <fcntl.h> 
 #include <sys/ioctl.h>
 #include <linux/spi/spidev.h> 
+#include <linux/gpio.h>
 #include "rpi_func.h"
+#include "motor_trace.h"
 
 /*
 *********************************************************************************************************
@@ -19,33 +25,221 @@
 *********************************************************************************************************
 */
 
+// gpio backend 상태 (rpi_gpio_setup())
+static int              gpio_backend = RPI_GPIO_AUTO;           // 선택된 backend (설정 전 AUTO)
+static int              gpio_chip_fd = -1;                      // cdev : /dev/gpiochipN
+static int              gpio_req_fd = -1;                       // cdev : line request fd
+static unsigned int     gpio_lines[RPI_GPIO_CDEV_MAX];          // cdev : 요청할 핀 (배열 순서 = values bit 번호)
+static int              gpio_nlines = 0;
+static uint32_t         gpio_bits = 0;                          // cdev : 현재 출력 값 (여러 스레드가 갱신, __atomic 으로만 접근)
+static int              gpio_dirty = 0;                         // cdev : 핀이 추가되어 rpi_gpio_request_lines() 필요
+
+/*
+* 주변장치 물리 주소 읽기 (/proc/device-tree/soc/ranges, big endian)
+* Pi 1 : 0x20000000 / Pi 2, 3 : 0x3F000000 / Pi 4 : 0xFE000000. 읽을 수 없으면 BCM2708_PERI_BASE.
+*/
+static unsigned long rpi_peri_base(void)
+{
+    unsigned char buf[12];
+    unsigned long base;
+    size_t n;
+    FILE *fp;
+
+    if((fp = fopen("/proc/device-tree/soc/ranges", "rb")) == NULL) return BCM2708_PERI_BASE;
+    n = fread(buf, 1, sizeof(buf), fp);
+    fclose(fp);
+    if(n < 8) return BCM2708_PERI_BASE;
+
+    base = (unsigned long)buf[4]<<24 | buf[5]<<16 | buf[6]<<8 | buf[7];
+    if( (base == 0) & (n >= 12) )   // Pi 4 : 부모 주소가 2 cell
+        base = (unsigned long)buf[8]<<24 | buf[9]<<16 | buf[10]<<8 | buf[11];
+    return base;
+}
+
+static int rpi_peri_is_bcm(unsigned long base)
+{
+    return (base == 0x20000000) | (base == 0x3F000000) | (base == 0xFE000000);
+}
+
+/*
+* GPIO 레지스터 메모리 매핑 (path 의 offset 부터 BLOCK_SIZE)
+*/
+static int gpio_mmap_setup(const char *path, off_t offset)
+{
+    void *map;
+    int fd;
+
+    if((fd = open(path, O_RDWR | O_SYNC | O_CLOEXEC)) < 0) return -1;
+
+    map = mmap(0, BLOCK_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, offset);
+    close(fd);  // 매핑은 fd 를 닫아도 유지됨
+    if(map == MAP_FAILED){
+        printf("%s mmap error\n", path);
+        return -1;
+    }
+    iom_gpio = (volatile unsigned int *)map;
+    return 0;
+}
+
+/*
+* GPIO chip 열기. chip 이 NULL 이면 Raspberry Pi 핀 제어기(label)를 찾고, 없으면 RPI_GPIO_CHIP_DEFAULT.
+*/
+static int gpio_cdev_open(const char *chip)
+{
+    struct gpiochip_info info;
+    char path[32];
+    int i, fd;
+
+    if(chip != NULL) return open(chip, O_RDWR | O_CLOEXEC);
+
+    for(i=0; i<8; i++){
+        snprintf(path, sizeof(path), "/dev/gpiochip%d", i);
+        if((fd = open(path, O_RDWR | O_CLOEXEC)) < 0) continue;
+
+        memset(&info, 0, sizeof(info));
+        if( (ioctl(fd, GPIO_GET_CHIPINFO_IOCTL, &info) == 0) &&
+            (strstr(info.label, "bcm2835") || strstr(info.label, "bcm2711") || strstr(info.label, "rp1")) )
+            return fd;
+        close(fd);
+    }
+    return open(RPI_GPIO_CHIP_DEFAULT, O_RDWR | O_CLOEXEC);
+}
+
+/*
+* 등록된 출력 핀 전체를 line request 1개로 요청 (초기 출력 값 bits)
+* 핀이 추가된 경우 기존 request 를 해제하고 다시 요청함. 초기화 경로(rpi_gpio_request_lines())에서만 호출.
+*/
+static int gpio_cdev_request(uint32_t bits)
+{
+    struct gpio_v2_line_request req;
+    int i;
+
+    if( (gpio_chip_fd < 0) | (gpio_nlines == 0) ) return -1;
+
+    memset(&req, 0, sizeof(req));
+    for(i=0; i<gpio_nlines; i++) req.offsets[i] = gpio_lines[i];
+    strncpy(req.consumer, RPI_GPIO_CONSUMER, sizeof(req.consumer) - 1);
+    req.num_lines                       = gpio_nlines;
+    req.config.flags                    = GPIO_V2_LINE_FLAG_OUTPUT;
+    req.config.num_attrs                = 1;
+    req.config.attrs[0].attr.id         = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+    req.config.attrs[0].attr.values     = bits;
+    req.config.attrs[0].mask            = (1ull << gpio_nlines) - 1;
+
+    if(gpio_req_fd >= 0) close(gpio_req_fd);
+    gpio_req_fd = -1;
+    if(ioctl(gpio_chip_fd, GPIO_V2_GET_LINE_IOCTL, &req) < 0){
+        printf("gpio line request error\n");
+        return -1;
+    }
+    gpio_req_fd = req.fd;
+    gpio_dirty  = 0;
+    __atomic_store_n(&gpio_bits, bits, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/*
+* request 안의 핀들(mask)의 출력 값을 bits 로 설정. ioctl 1번 (mask 밖의 핀은 바뀌지 않음).
+* 값이 같아도 ioctl 을 생략하지 않음 : 축 스레드와 비상 정지(시그널 핸들러, watchdog)가 같은 핀을 동시에 쓰면
+* gpio_bits 갱신 순서와 ioctl 순서가 뒤바뀔 수 있으므로, 생략하면 핀이 마지막 호출과 다른 값으로 남을 수 있음.
+* ioctl 에는 gpio_bits 가 아닌 호출자의 bits 를 그대로 전달하고, gpio_bits 는 다시 request 할 때의 초기값으로만 사용 (CAS 로 갱신).
+* request 가 없으면 요청하지 않고 실패함 (printf, close 없음, async-signal-safe).
+*/
+static int gpio_cdev_set(uint32_t bits, uint32_t mask)
+{
+    struct gpio_v2_line_values val;
+    uint32_t cur, next;
+
+    if( gpio_dirty | (gpio_req_fd < 0) ) return -1;
+
+    cur = __atomic_load_n(&gpio_bits, __ATOMIC_ACQUIRE);
+    do{
+        next = (cur & ~mask) | (bits & mask);
+    }while(!__atomic_compare_exchange_n(&gpio_bits, &cur, next, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    val.bits = bits & mask;
+    val.mask = mask;
+    if(ioctl(gpio_req_fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &val) < 0) return -1;
+    return 0;
+}
+
+static int gpio_cdev_index(unsigned int pin_num)
+{
+    int i;
+
+    for(i=0; i<gpio_nlines; i++)
+        if(gpio_lines[i] == pin_num) return i;
+    return -1;
+}
+
 /* 
-* gpio mapping
-* int motor_hw_init(void)
+* gpio 초기화 (backend 자동 선택)
+* int rpi_gpio_setup(void)
 * 입력 값 : 없음
 * 반환 값 : 성공 0 / 실패 -1
-* 설명 : 라즈베리파이의 메모리 디바이스 파일을 열고 그에 대한 메모리 매핑을 하여 gpio에 접근 가능토록 함 
+* 설명 : 환경 변수 RPI_GPIO_BACKEND(gpiomem / mem / cdev), RPI_GPIO_CHIP 이 있으면 그 값을 사용하고
+*       없으면 RPI_GPIO_AUTO 로 rpi_gpio_setup_backend() 호출.
 */
 int rpi_gpio_setup(void)
 {
-    int mem_fd; 
-    int ret = 0;
+    const char *name = getenv("RPI_GPIO_BACKEND");
+    int backend = RPI_GPIO_AUTO;
 
-	//BCM2835 메모리 디바이스 파일 오픈		
-	if ((mem_fd = open ("/dev/mem", O_RDWR | O_SYNC | O_CLOEXEC)) < 0){
-		printf("mem open error\n");						   
-		return -1;
-	}
+    if(name != NULL){
+        if(strcmp(name, "gpiomem") == 0)    backend = RPI_GPIO_GPIOMEM;
+        else if(strcmp(name, "mem") == 0)   backend = RPI_GPIO_DEVMEM;
+        else if(strcmp(name, "cdev") == 0)  backend = RPI_GPIO_CDEV;
+    }
+    return rpi_gpio_setup_backend(backend, getenv("RPI_GPIO_CHIP"));
+}
 
-    //GPIO_BASE부터 BLOCK_SIZE만큼의 동적 메모리 할당하고 시작 주소 반환.
-    if((iom_gpio = (unsigned int *)mmap(0, BLOCK_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, mem_fd, GPIO_BASE)) == NULL){
-		printf("mmap error\n");
-		return -1;
+/* 
+* gpio backend 초기화
+* int rpi_gpio_setup_backend(int backend, const char *chip)
+* 입력 값 : backend ==> RPI_GPIO_AUTO / RPI_GPIO_GPIOMEM / RPI_GPIO_DEVMEM / RPI_GPIO_CDEV
+*         chip ==> cdev 에서 사용할 /dev/gpiochipN (NULL 이면 자동)
+* 반환 값 : 성공 0 / 실패 -1
+* 설명 : AUTO 는 gpiomem --> mem --> cdev 순서로 시도. 메모리 매핑은 BCM 주변장치 주소일 때만 자동 선택됨.
+*/
+int rpi_gpio_setup_backend(int backend, const char *chip)
+{
+    unsigned long base = rpi_peri_base();
+    int bcm = rpi_peri_is_bcm(base) | (backend != RPI_GPIO_AUTO);
+
+    if(gpio_backend != RPI_GPIO_AUTO) return -1;
+
+    if( bcm & ((backend == RPI_GPIO_AUTO) | (backend == RPI_GPIO_GPIOMEM)) ){
+        if(gpio_mmap_setup("/dev/gpiomem", 0) == 0)
+            gpio_backend = RPI_GPIO_GPIOMEM;
+    }
+    if( bcm & (gpio_backend == RPI_GPIO_AUTO) & ((backend == RPI_GPIO_AUTO) | (backend == RPI_GPIO_DEVMEM)) ){
+        if(gpio_mmap_setup("/dev/mem", base + GPIO_OFFSET) == 0)
+            gpio_backend = RPI_GPIO_DEVMEM;
+    }
+    if( (gpio_backend == RPI_GPIO_AUTO) & ((backend == RPI_GPIO_AUTO) | (backend == RPI_GPIO_CDEV)) ){
+        if((gpio_chip_fd = gpio_cdev_open(chip)) >= 0){
+            gpio_nlines     = 0;
+            gpio_backend    = RPI_GPIO_CDEV;
+            __atomic_store_n(&gpio_bits, 0, __ATOMIC_RELEASE);
+        }
+    }
+    if(gpio_backend == RPI_GPIO_AUTO){
+        printf("gpio setup error\n");
+        return -1;
     }
-    
     return 0;
 }
 
+/* 
+* 선택된 gpio backend
+* int rpi_gpio_backend(void)
+* 반환 값 : RPI_GPIO_GPIOMEM / RPI_GPIO_DEVMEM / RPI_GPIO_CDEV (설정 전 RPI_GPIO_AUTO)
+*/
+int rpi_gpio_backend(void)
+{
+    return gpio_backend;
+}
+
 /* 
 * 핀의 입/출력 설정 함수
 * int rpi_gpio_direction(unsigned int pin_num, unsigned int mode)
@@ -60,6 +254,17 @@ int rpi_gpio_direction(unsigned int pin_num, unsigned int mode)
     if(pin_num > 40) return -1;
     /* 하나의 GPIO에 대한 기능은 3개의 bit로 표현됨 */
     if(mode > 7) return -1;
+
+    //cdev : 출력 핀을 line request 에 추가 (rpi_gpio_request_lines()로 요청)
+    if(gpio_backend == RPI_GPIO_CDEV){
+        if(mode != OUTPUT)                      return -1;
+        if(gpio_cdev_index(pin_num) >= 0)       return 0;
+        if(gpio_nlines >= RPI_GPIO_CDEV_MAX)    return -1;
+        gpio_lines[gpio_nlines++] = pin_num;
+        gpio_dirty = 1;
+        return 0;
+    }
+    if(iom_gpio == NULL) return -1;
  
     switch(mode){
         INP_GPIO(pin_num);
@@ -72,6 +277,26 @@ int rpi_gpio_direction(unsigned int pin_num, unsigned int mode)
     return 0;
 }
 
+/* 
+* 출력 핀 line request 함수 (cdev)
+* int rpi_gpio_request_lines(unsigned int set_mask)
+* 입력 값 : set_mask ==> 초기 출력 값이 SET(1)인 핀들의 bit mask (bit n = BCM n, 0~31), 나머지는 CLEAR(0)
+* 반환 값 : 성공 0 / 실패 -1
+* 설명 : rpi_gpio_direction(OUTPUT)으로 설정한 핀들을 line request 1개로 요청. 핀 설정 후 쓰기 전에 1번 호출.
+*       cdev 가 아니면 아무것도 하지 않음. 시그널 핸들러에서 사용하지 않음.
+*/
+int rpi_gpio_request_lines(unsigned int set_mask)
+{
+    uint32_t bits = 0;
+    int i;
+
+    if(gpio_backend != RPI_GPIO_CDEV) return 0;
+
+    for(i=0; i<gpio_nlines; i++)
+        if( (gpio_lines[i] <= 31) && (set_mask & (1u << gpio_lines[i])) ) bits |= 1u << i;
+    return gpio_cdev_request(bits);
+}
+
 /* 
 * 핀의 함수 설정 함수
 * int rpi_gpio_alt_func(unsigned int pin_num, unsigned int mode)
@@ -86,6 +311,7 @@ int rpi_gpio_alt_func(unsigned int pin_num, unsigned int mode)
     if(pin_num > 40) return -1;
     /* 하나의 GPIO에 대한 기능은 3개의 bit로 표현됨 */
     if(mode > 7) return -1;
+    if(iom_gpio == NULL) return -1;     // cdev 는 지원하지 않음
  
     SET_GPIO_ALT(pin_num,mode);
  
@@ -105,9 +331,51 @@ int rpi_gpio_write(unsigned int pin_num, unsigned int status)
     if(pin_num > 40)                    return -1;
     if(status != OFF && status != ON)   return -1;
 
+    if(gpio_backend == RPI_GPIO_CDEV){
+        int idx = gpio_cdev_index(pin_num);
+
+        if(idx < 0) return -1;
+        if(gpio_cdev_set((uint32_t)(status == ON) << idx, 1u << idx) < 0) return -1;
+        MOTOR_TRACE2(gpio_write, pin_num, status);
+        return 0;
+    }
+    if(iom_gpio == NULL) return -1;
+
      /* status 값에 따라 set과 clear 중 하나를 선택 할 수 있음 */
     if(status == OFF) GPIO_CLEAR(pin_num); 
     else if(status == ON) GPIO_SET(pin_num);
+    MOTOR_TRACE2(gpio_write, pin_num, status);
+    return 0;
+}
+
+/* 
+* 여러 핀의 출력 상태를 한번에 설정
+* int rpi_gpio_write_mask(unsigned int set_mask, unsigned int clr_mask)
+* 입력 값 : set_mask ==> SET(1)으로 설정할 핀들의 bit mask (bit n = BCM n, 0~31)
+*         clr_mask ==> CLEAR(0)으로 설정할 핀들의 bit mask
+* 반환 값 : 성공 0 / 실패 -1
+* 설명 : GPSET0, GPCLR0 레지스터에 1번씩만 저장하므로 시그널 핸들러에서도 사용 가능(async-signal-safe).
+*       cdev 는 request 에 포함된 핀만 GPIO_V2_LINE_SET_VALUES_IOCTL 1번으로 설정 (값이 같아도 항상 전달, rpi_gpio_write()도 동일).
+*       cdev 에서 rpi_gpio_request_lines() 전이면 요청하지 않고 -1.
+*/
+int rpi_gpio_write_mask(unsigned int set_mask, unsigned int clr_mask)
+{
+    if(gpio_backend == RPI_GPIO_CDEV){
+        uint32_t bits = 0, mask = 0;
+        int i;
+
+        for(i=0; i<gpio_nlines; i++){
+            if(gpio_lines[i] > 31) continue;
+            if(set_mask & (1u << gpio_lines[i]))        { bits |= 1u << i; mask |= 1u << i; }
+            else if(clr_mask & (1u << gpio_lines[i]))   mask |= 1u << i;
+        }
+        if(mask == 0) return 0;
+        return gpio_cdev_set(bits, mask);
+    }
+    if(iom_gpio == NULL) return -1;
+
+    if(clr_mask) *(iom_gpio+10) = clr_mask;
+    if(set_mask) *(iom_gpio+7)  = set_mask;
     return 0;
 }
 
@@ -121,10 +389,32 @@ int rpi_gpio_write(unsigned int pin_num, unsigned int status)
 int rpi_gpio_read(unsigned int pin_num)
 {
     if(pin_num > 40)                    return -1;
+
+    if(gpio_backend == RPI_GPIO_CDEV){
+        struct gpio_v2_line_values val;
+        int idx = gpio_cdev_index(pin_num);
+
+        if( (idx < 0) | (gpio_req_fd < 0) ) return -1;
+        val.bits = 0;
+        val.mask = 1ull << idx;
+        if(ioctl(gpio_req_fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &val) < 0) return -1;
+        return !!(val.bits & val.mask);
+    }
+    if(iom_gpio == NULL) return -1;
     return GPIO_READ(pin_num);
 }
 
 
+// spi 트랜잭션 계층 채널별 상태 (rpi_spi_transfer())
+static struct spi_health    spi_hs[SPI_MAX_DEV];
+static long                 spi_budget_ns[SPI_MAX_DEV];
+static int                  spi_retries[SPI_MAX_DEV];
+static long                 spi_xfer_ns[SPI_MAX_DEV];   // 1회 전송 시간 (이동 평균)
+static unsigned long        spi_ok_run[SPI_MAX_DEV];    // 연속 성공 횟수
+// 위 상태는 같은 채널을 여러 스레드(axis_rt.c 축 스레드의 공유 DAC 채널 등)가 갱신하므로 spi_hs_lock 으로 보호.
+// 전송(ioctl) 중에는 잡지 않음. estop.c 는 rpi_spi_data_rw()를 직접 사용하므로 잡지 않음.
+static pthread_mutex_t      spi_hs_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /*
 *********************************************************************************************************
 *                                      RASPBERRY PI SPI FUNC
@@ -147,22 +437,41 @@ int rpi_gpio_read(unsigned int pin_num)
           speed ==> spi 통신 속도 
           delay ==> 딜레이
 * 반환 값 : 성공 0 / 실패 -1
-* 설명 : spi 통신 설정
+* 설명 : spi 통신 설정. /dev/spidev0.<channel> 사용.
 */
 int rpi_spi_setup(int channel, int mode, int bits_per_word, int speed, int delay)
+{
+    return rpi_spi_setup_bus(channel & 0x3, 0, channel & 0x3, mode, bits_per_word, speed, delay);
+}
+
+/* 
+* 임의의 spi 버스 설정
+* int rpi_spi_setup_bus(int channel, int bus, int cs, int mode, int bits_per_word, int speed, int delay)
+* 입력 값 : channel ==> 설정된 디바이스를 저장할 채널 번호 (0 ~ SPI_MAX_DEV-1)
+          bus ==> spi 버스 번호 (spidev<bus>.x)
+          cs ==> chip select 번호 (spidevx.<cs>)
+          mode, bits_per_word, speed, delay ==> rpi_spi_setup() 참조
+* 반환 값 : 성공 0 / 실패 -1
+* 설명 : 축(바퀴)마다 다른 spi 버스를 사용할 수 있도록 /dev/spidev<bus>.<cs> 를 channel 에 연결.
+*       이후 rpi_spi_data_rw()에는 channel 번호를 사용.
+*/
+int rpi_spi_setup_bus(int channel, int bus, int cs, int mode, int bits_per_word, int speed, int delay)
 {
 	char  fName[128];
-	int   spi_channel = channel & 0x3;
+	int   spi_channel = channel;
 	int   spi_mode    = mode & 0x3;  
 	int   spi_bpw     = bits_per_word; 
 	int   spi_delay   = delay ; 
 	int   spi_speed   = speed;   
 	int   ret;
 
+    if( (spi_channel < 0) | (spi_channel >= SPI_MAX_DEV) ) return -1;
+
 	//spidev 파일 오픈
-    sprintf (fName, "/dev/spidev0.%d", spi_channel) ;
+    sprintf (fName, "/dev/spidev%d.%d", bus, cs) ;
 	if((spi_fds[spi_channel] = open (fName , O_RDWR)) < 0 ){
    	   printf("spi open error\n"); 
+   	   spi_fds[spi_channel] = 0;
    	   return -1;
 	}
 
@@ -186,7 +495,7 @@ int rpi_spi_setup(int channel, int mode, int bits_per_word, int speed, int delay
     ioctl(spi_fds[spi_channel], SPI_IOC_RD_BITS_PER_WORD, &spi_bpw);
     ioctl(spi_fds[spi_channel], SPI_IOC_RD_MAX_SPEED_HZ, &spi_speed);
     
-    printf("spi DAC \n");
+    printf("spi %s \n", fName);
     printf("spi mode: %d\n", spi_mode);
     printf("bits per word: %d\n", spi_bpw);
     printf("max speed: %d Hz (%d KHz)\n", spi_speed, spi_speed/1000);
@@ -195,7 +504,19 @@ int rpi_spi_setup(int channel, int mode, int bits_per_word, int speed, int delay
     //전역변수에 값 저장.
    	spi_bpws[spi_channel]     	= bits_per_word; 
 	spi_delays[spi_channel]   	= delay ; 
-	spi_speeds[spi_channel]   	= speed;   
+	__atomic_store_n(&spi_speeds[spi_channel], speed, __ATOMIC_RELAXED);
+
+    //트랜잭션 계층 상태 초기화
+    pthread_mutex_lock(&spi_hs_lock);
+    memset(&spi_hs[spi_channel], 0, sizeof(struct spi_health));
+    spi_hs[spi_channel].health      = SPI_HEALTH_MAX;
+    spi_hs[spi_channel].speed       = speed;
+    spi_hs[spi_channel].speed_set   = speed;
+    spi_budget_ns[spi_channel]      = SPI_BUDGET_US * 1000L;
+    spi_retries[spi_channel]        = SPI_XFER_RETRY;
+    spi_xfer_ns[spi_channel]        = 0;
+    spi_ok_run[spi_channel]         = 0;
+    pthread_mutex_unlock(&spi_hs_lock);
 
     return 0;
 }
@@ -208,15 +529,18 @@ int rpi_spi_setup(int channel, int mode, int bits_per_word, int speed, int delay
 */
 void rpi_spi_close(void)
 {
-    close(spi_fds[0]);
-    close(spi_fds[1]);
-    close(spi_fds[2]);
+    int i;
+
+    for(i=0; i<SPI_MAX_DEV; i++){
+        if(spi_fds[i] > 0) close(spi_fds[i]);
+        spi_fds[i] = 0;
+    }
 }
 
 /* 
 * spi 데이터 읽기/쓰기
 * int rpi_spi_data_rw(int channel, unsigned char *data, int len) 
-* 입력 값 : channel ==> 쓰고 읽고자 하는 spi 채널. 현재 0~4까지 존재.
+* 입력 값 : channel ==> 쓰고 읽고자 하는 spi 채널 (0 ~ SPI_MAX_DEV-1).
           data ==> 입력하고자 하는 데이터
           len ==> 데이터의 길이(bpw 기준)
 * 반환 값 : 쓰고 읽은 데이터의 길이(bpw 기준)
@@ -225,14 +549,239 @@ void rpi_spi_close(void)
 int rpi_spi_data_rw(int channel, unsigned char *data, int len) 
 {
     struct spi_ioc_transfer spi = {0,}; 
+    int ret;
     
-    channel             &= 0x3 ; 
+    if( (channel < 0) | (channel >= SPI_MAX_DEV) ) return -1;
+    MOTOR_TRACE2(spi_rw_entry, channel, len);
     spi.tx_buf          = (unsigned long)data ; 
     spi.rx_buf          = (unsigned long)data ;      
     spi.len             = len ;  
     spi.delay_usecs     = spi_delays[channel]; 
-    spi.speed_hz        = spi_speeds[channel] ; 
+    spi.speed_hz        = __atomic_load_n(&spi_speeds[channel], __ATOMIC_RELAXED);  // 축 스레드가 spi_health_update()에서 변경
     spi.bits_per_word   = spi_bpws[channel] ; 
     
-    return ioctl (spi_fds[channel], SPI_IOC_MESSAGE(1), &spi) ; 
+    ret = ioctl (spi_fds[channel], SPI_IOC_MESSAGE(1), &spi) ; 
+    MOTOR_TRACE2(spi_rw_return, channel, ret);
+    return ret;
+}
+
+/*
+* count 개의 프레임을 클럭 speed 로 전송 (rpi_spi_data_rw_multi(), rpi_spi_transfer())
+*/
+static int spi_rw_frames(int channel, unsigned char *data, int len, int count, uint32_t speed)
+{
+    struct spi_ioc_transfer spi[SPI_MULTI_MAX]; 
+    int i, ret;
+    
+    if( (count < 1) | (count > SPI_MULTI_MAX) )    return -1;
+    MOTOR_TRACE2(spi_rw_entry, channel, len * count);
+
+    memset(spi, 0, sizeof(spi));
+    for(i=0; i<count; i++){
+        spi[i].tx_buf           = (unsigned long)(data + i * len) ; 
+        spi[i].rx_buf           = (unsigned long)(data + i * len) ;      
+        spi[i].len              = len ;  
+        spi[i].delay_usecs      = spi_delays[channel]; 
+        spi[i].speed_hz         = speed; 
+        spi[i].bits_per_word    = spi_bpws[channel] ; 
+        spi[i].cs_change        = (i < count - 1);  // 마지막 프레임은 기본 동작(CS 해제)
+    }
+    
+    ret = ioctl (spi_fds[channel], SPI_IOC_MESSAGE(count), spi) ; 
+    MOTOR_TRACE2(spi_rw_return, channel, ret);
+    return ret;
+}
+
+/* 
+* spi 다중 프레임 읽기/쓰기
+* int rpi_spi_data_rw_multi(int channel, unsigned char *data, int len, int count) 
+* 입력 값 : channel ==> 쓰고 읽고자 하는 spi 채널 (0 ~ SPI_MAX_DEV-1).
+          data ==> 프레임 count 개가 연속으로 저장된 버퍼 (len * count)
+          len ==> 프레임 1개의 길이(bpw 기준)
+          count ==> 프레임 수 (1 ~ SPI_MULTI_MAX)
+* 반환 값 : 쓰고 읽은 데이터의 전체 길이(bpw 기준) / 실패 -1
+* 설명 : count 개의 프레임을 ioctl 1번(SPI_IOC_MESSAGE(count))으로 전송.
+*       프레임 사이마다 CS 를 해제(cs_change)하므로 엔코더는 프레임마다 새로 샘플링함.
+*/
+int rpi_spi_data_rw_multi(int channel, unsigned char *data, int len, int count) 
+{
+    if( (channel < 0) | (channel >= SPI_MAX_DEV) ) return -1;
+
+    return spi_rw_frames(channel, data, len, count, __atomic_load_n(&spi_speeds[channel], __ATOMIC_RELAXED));
+}
+
+/*
+*********************************************************************************************************
+*                                      RASPBERRY PI SPI TRANSACTION FUNC
+*********************************************************************************************************
+*/
+
+static long spi_elapsed_ns(const struct timespec *from, const struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) * 1000000000L + (to->tv_nsec - from->tv_nsec);
+}
+
+/*
+* health 점수 갱신. 점수가 떨어지면 클럭을 낮추고, 연속 성공이 쌓이면 복구. (spi_hs_lock 을 잡고 호출)
+* 클럭을 절반으로 낮추면 전송 시간이 2배가 되므로, 측정된 전송 시간의 2배가 budget 안에 들어갈 때만 낮춤.
+* (SPI_ENC_SPEED 의 엔코더 프레임처럼 이미 budget 을 넘는 채널은 낮추지 않음)
+*/
+static void spi_health_update(int channel, int ok)
+{
+    struct spi_health *h = &spi_hs[channel];
+
+    if(ok){
+        h->ok++;
+        if((h->health += SPI_HEALTH_OK) > SPI_HEALTH_MAX) h->health = SPI_HEALTH_MAX;
+        if( (++spi_ok_run[channel] >= SPI_SPEED_RESTORE) & (h->speed < h->speed_set) ){
+            h->speed = (h->speed * 2 > h->speed_set) ? h->speed_set : h->speed * 2;
+            __atomic_store_n(&spi_speeds[channel], h->speed, __ATOMIC_RELAXED);
+            spi_ok_run[channel] = 0;
+        }
+    }
+    else{
+        h->fail++;
+        spi_ok_run[channel] = 0;
+        if((h->health -= SPI_HEALTH_FAIL) < 0) h->health = 0;
+        if( (h->health <= SPI_HEALTH_SLOW) & (h->speed > SPI_SPEED_MIN) &
+            (spi_xfer_ns[channel] > 0) & (spi_xfer_ns[channel] * 2 <= spi_budget_ns[channel]) ){
+            h->speed = (h->speed / 2 < SPI_SPEED_MIN) ? SPI_SPEED_MIN : h->speed / 2;
+            __atomic_store_n(&spi_speeds[channel], h->speed, __ATOMIC_RELAXED);
+            spi_xfer_ns[channel] = 0;           // 클럭이 바뀌었으므로 전송 시간 다시 측정
+            h->health = SPI_HEALTH_DEGRADED;    // 낮춘 클럭으로 다시 판단
+            h->slow++;
+#ifdef DEBUG
+            printf("spi channel %d clock down %u Hz\n", channel, h->speed);
+#endif
+        }
+    }
+
+    if(h->health == 0)                          h->state = SPI_ST_FAILED;
+    else if(h->health <= SPI_HEALTH_DEGRADED)   h->state = SPI_ST_DEGRADED;
+    else                                        h->state = SPI_ST_OK;
+}
+
+/* 
+* spi 트랜잭션 시간 예산 설정
+* int rpi_spi_set_budget(int channel, int budget_us, int retries)
+* 입력 값 : channel ==> spi 채널 (0 ~ SPI_MAX_DEV-1)
+          budget_us ==> rpi_spi_transfer() 1번에 허용하는 시간 (us)
+          retries ==> 최대 재시도 횟수
+* 반환 값 : 성공 0 / 실패 -1
+*/
+int rpi_spi_set_budget(int channel, int budget_us, int retries)
+{
+    if( (channel < 0) | (channel >= SPI_MAX_DEV) )  return -1;
+    if( (budget_us < 0) | (retries < 0) )           return -1;
+
+    pthread_mutex_lock(&spi_hs_lock);
+    spi_budget_ns[channel]  = budget_us * 1000L;
+    spi_retries[channel]    = retries;
+    pthread_mutex_unlock(&spi_hs_lock);
+    return 0;
+}
+
+/* 
+* spi 트랜잭션 (재시도, health 관리)
+* int rpi_spi_transfer(int channel, unsigned char *data, int len, int count) 
+* 입력 값 : channel ==> 쓰고 읽고자 하는 spi 채널 (0 ~ SPI_MAX_DEV-1).
+          data ==> 전송할 데이터. 수신 데이터로 덮어씀
+          len ==> 프레임 1개의 길이(bpw 기준)
+          count ==> 프레임 수 (1 ~ SPI_MULTI_MAX, ioctl 1번으로 전송)
+* 반환 값 : 성공 쓰고 읽은 데이터의 전체 길이 / 실패 -1 (data 의 내용은 유효하지 않음)
+* 설명 : ioctl 실패 또는 전송 길이가 다르면 실패로 보고, budget 안에서 tx 데이터를 복원하여 재시도.
+*       len * count 가 SPI_XFER_MAX 보다 크면 재시도하지 않음.
+*/
+int rpi_spi_transfer(int channel, unsigned char *data, int len, int count) 
+{
+    unsigned char tx[SPI_XFER_MAX];
+    struct timespec t0, t1, t2;
+    int ret = -1, attempt, total = len * count, keep, retry;
+    long elapsed = 0, cost = 0;
+    uint32_t speed;
+
+    if( (channel < 0) | (channel >= SPI_MAX_DEV) )  return -1;
+    if( (data == NULL) | (len <= 0) | (count < 1) ) return -1;
+
+    keep = (total <= SPI_XFER_MAX);
+    if(keep) memcpy(tx, data, total);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(attempt=0; ; attempt++){
+        //클럭은 다른 스레드의 spi_health_update()가 바꿀 수 있으므로 lock 안에서 읽어 전달
+        pthread_mutex_lock(&spi_hs_lock);
+        speed = spi_speeds[channel];
+        pthread_mutex_unlock(&spi_hs_lock);
+
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        ret = spi_rw_frames(channel, data, len, count, speed);
+        clock_gettime(CLOCK_MONOTONIC, &t2);
+
+        //1회 전송 시간 갱신, 재시도 가능 여부 (횟수, tx 보관, 시간 예산)
+        cost    = spi_elapsed_ns(&t1, &t2);
+        elapsed = spi_elapsed_ns(&t0, &t2);
+        retry   = 0;
+        pthread_mutex_lock(&spi_hs_lock);
+        spi_xfer_ns[channel] = (spi_xfer_ns[channel] == 0) ? cost : (spi_xfer_ns[channel] * 3 + cost) / 4;
+        if(ret != total) MOTOR_TRACE4(spi_retry, channel, attempt, ret, spi_hs[channel].health);
+        if( (ret != total) & (attempt < spi_retries[channel]) & keep ){
+            if(elapsed + spi_xfer_ns[channel] > spi_budget_ns[channel]) spi_hs[channel].over++;
+            else{
+                spi_hs[channel].retry++;
+                retry = 1;
+            }
+        }
+        pthread_mutex_unlock(&spi_hs_lock);
+
+        if(!retry) break;
+        memcpy(data, tx, total);
+    }
+
+    pthread_mutex_lock(&spi_hs_lock);
+    spi_health_update(channel, ret == total);
+    pthread_mutex_unlock(&spi_hs_lock);
+    return (ret == total) ? ret : -1;
+}
+
+/* 
+* 데이터 오류 알림 (parity 오류 등 전송은 성공했으나 내용이 잘못된 경우)
+* void rpi_spi_note_error(int channel)
+* 설명 : 잡음으로 인한 오류도 클럭을 낮추면 줄어들기 때문에 health 에 반영함.
+*/
+void rpi_spi_note_error(int channel)
+{
+    if( (channel < 0) | (channel >= SPI_MAX_DEV) ) return;
+
+    pthread_mutex_lock(&spi_hs_lock);
+    spi_health_update(channel, 0);
+    pthread_mutex_unlock(&spi_hs_lock);
+}
+
+/* 
+* 채널 상태 읽기
+* int rpi_spi_state(int channel)
+* 반환 값 : SPI_ST_OK / SPI_ST_DEGRADED / SPI_ST_FAILED (잘못된 채널)
+* int rpi_spi_get_health(int channel, struct spi_health *health)
+* 반환 값 : 성공 0 / 실패 -1
+*/
+int rpi_spi_state(int channel)
+{
+    int state;
+
+    if( (channel < 0) | (channel >= SPI_MAX_DEV) ) return SPI_ST_FAILED;
+
+    pthread_mutex_lock(&spi_hs_lock);
+    state = spi_hs[channel].state;
+    pthread_mutex_unlock(&spi_hs_lock);
+    return state;
+}
+
+int rpi_spi_get_health(int channel, struct spi_health *health)
+{
+    if( (channel < 0) | (channel >= SPI_MAX_DEV) | (health == NULL) ) return -1;
+
+    pthread_mutex_lock(&spi_hs_lock);
+    *health = spi_hs[channel];
+    pthread_mutex_unlock(&spi_hs_lock);
+    return 0;
 }
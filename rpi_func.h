@@ -24,6 +24,7 @@
     #define GPIO_BASE       (BCM2708_PERI_BASE + 0x200000) /* GPIO controller */
 #endif
 
+#define GPIO_OFFSET         0x200000                        /* 주변장치 주소 기준 GPIO offset */
 #define CLOCK_BASE      	(BCM2708_PERI_BASE + 0x101000) /* CLOCK controller */
 #define PWM_BASE        	(BCM2708_PERI_BASE + 0x20C000) /* PWM controller */
 
@@ -51,6 +52,26 @@ static volatile unsigned int *iom_gpio;
 #define OUTPUT 1
 #define INPUT 0
 
+/*
+* GPIO backend (rpi_gpio_setup())
+*   RPI_GPIO_GPIOMEM : /dev/gpiomem 메모리 매핑 (root 불필요)
+*   RPI_GPIO_DEVMEM  : /dev/mem 메모리 매핑 (root 필요). 주변장치 주소는 /proc/device-tree/soc/ranges 에서 읽음
+*   RPI_GPIO_CDEV    : GPIO character device v2 uAPI (/dev/gpiochipN). Pi 5, gpio-sim 등 BCM 레지스터가 없는 경우
+* RPI_GPIO_AUTO 는 위 순서(빠른 것부터)로 시도하며, 메모리 매핑은 BCM2835/2836/2711 주변장치 주소일 때만 사용.
+* 환경 변수 RPI_GPIO_BACKEND=gpiomem|mem|cdev 로 backend 를, RPI_GPIO_CHIP=/dev/gpiochipN 으로 chip 을 지정할 수 있음.
+* cdev 는 rpi_gpio_direction(OUTPUT)으로 설정한 핀들을 rpi_gpio_request_lines()로 line request 1개로 묶어 요청하고,
+* 이후 rpi_gpio_write()/rpi_gpio_write_mask()는 GPIO_V2_LINE_SET_VALUES_IOCTL 1번으로 전달함 (요청 전에는 -1).
+* (값이 같아도 ioctl 을 생략하지 않음. cdev 는 출력 핀만 지원하며 rpi_gpio_alt_func()는 -1)
+*/
+#define RPI_GPIO_AUTO       0
+#define RPI_GPIO_GPIOMEM    1
+#define RPI_GPIO_DEVMEM     2
+#define RPI_GPIO_CDEV       3
+
+#define RPI_GPIO_CHIP_DEFAULT   "/dev/gpiochip0"
+#define RPI_GPIO_CDEV_MAX       16              // line request 1개에 묶을 수 있는 최대 핀 수
+#define RPI_GPIO_CONSUMER       "raspi-motor"
+
 #define ON 1
 #define OFF 0
 
@@ -89,18 +110,70 @@ static volatile unsigned int *iom_gpio;
 #define SPI_DAC_SPEED_MAX   50000000 	// DAC 최대 동작 주파수 50MHz
 #define SPI_ENC_SPEED 		10000  		//10KHz
 
+/*
+* SPI 디바이스 번호(channel)는 spi_fds[] 의 인덱스.
+* rpi_spi_setup()은 /dev/spidev0.<channel> 을 열고,
+* rpi_spi_setup_bus()는 임의의 /dev/spidev<bus>.<cs> 를 지정한 channel에 연결함.
+* 축(바퀴)별로 다른 SPI 버스를 사용할 경우 SPI_BUS1_* 채널을 사용.
+*/
+#define SPI_MAX_DEV 8
+
 #define SPI_DAC_CHANNEL 0
 #define SPI_ENC_L_CHANNEL 1
 #define SPI_ENC_R_CHANNEL 2
 
+#define SPI_BUS1_DAC_CHANNEL 3  // /dev/spidev1.0
+#define SPI_BUS1_ENC_CHANNEL 4  // /dev/spidev1.1
+
+#define SPI_MULTI_MAX 16 // rpi_spi_data_rw_multi() 한번에 전송 가능한 최대 프레임 수
+
 #define SPI_MODE 0
 #define SPI_BPW  8
 #define SPI_DELAY 0
 
-static uint32_t 		spi_fds[3]		= {0,};
-static uint32_t 	    spi_speeds[3]	= {0,}; 
-static uint32_t 	    spi_delays[3] 	= {0,}; 
-static uint32_t 	    spi_bpws[3]		= {0,}; 
+/*
+* spi 트랜잭션 계층 (rpi_spi_transfer())
+* 채널별 시간 예산(budget) 안에서만 재시도하고, 결과로 채널별 health 점수(0 ~ SPI_HEALTH_MAX)를 갱신.
+*   성공 : +SPI_HEALTH_OK / 실패 : -SPI_HEALTH_FAIL
+*   health <= SPI_HEALTH_SLOW 이면 클럭을 절반으로 낮춤 (SPI_SPEED_MIN 까지, 2배가 된 전송 시간이 budget 안에 들어갈 때만)
+*   SPI_SPEED_RESTORE 번 연속 성공하면 클럭을 2배로 (설정 값까지) 복구
+* 상태 : SPI_ST_OK (health > SPI_HEALTH_DEGRADED) / SPI_ST_DEGRADED / SPI_ST_FAILED (health 0)
+* 첫 시도는 항상 수행하며, 재시도는 (경과 시간 + 측정된 1회 전송 시간)이 budget 안에 들어갈 때만 수행.
+* budget 은 제어 주기 안에 들어가도록 설정할 것 (기본 SPI_BUDGET_US, rpi_spi_set_budget()).
+* SPI_ENC_SPEED(10KHz)에서 엔코더 프레임 1개는 약 2.4ms 로 budget 을 넘으므로 엔코더 채널은 재시도, 클럭 낮춤 없이 동작함.
+*/
+#define SPI_BUDGET_US       300     // 채널별 기본 시간 예산 (us)
+#define SPI_XFER_RETRY      2       // 기본 최대 재시도 횟수
+#define SPI_XFER_MAX        64      // 재시도를 위해 tx 데이터를 보관할 수 있는 최대 길이 (byte)
+
+#define SPI_HEALTH_MAX      100
+#define SPI_HEALTH_OK       1
+#define SPI_HEALTH_FAIL     20
+#define SPI_HEALTH_DEGRADED 60
+#define SPI_HEALTH_SLOW     30
+#define SPI_SPEED_MIN       5000    // 5KHz
+#define SPI_SPEED_RESTORE   10000
+
+#define SPI_ST_OK           0
+#define SPI_ST_DEGRADED     1
+#define SPI_ST_FAILED       2
+
+struct spi_health {
+    int             state;      // SPI_ST_*
+    int             health;     // 0 ~ SPI_HEALTH_MAX
+    uint32_t        speed;      // 현재 클럭 (Hz)
+    uint32_t        speed_set;  // 설정된 클럭 (Hz)
+    unsigned long   ok;         // 성공한 트랜잭션 수
+    unsigned long   fail;       // 실패한 트랜잭션 수 (재시도 후에도 실패, rpi_spi_note_error() 포함)
+    unsigned long   retry;      // 재시도 횟수
+    unsigned long   over;       // budget 부족으로 재시도하지 못한 횟수
+    unsigned long   slow;       // 클럭을 낮춘 횟수
+};
+
+static int      		spi_fds[SPI_MAX_DEV]		= {0,};  // 0 : 열리지 않음
+static uint32_t 	    spi_speeds[SPI_MAX_DEV]	= {0,}; 
+static uint32_t 	    spi_delays[SPI_MAX_DEV] 	= {0,}; 
+static uint32_t 	    spi_bpws[SPI_MAX_DEV]		= {0,}; 
 
 /*
 *********************************************************************************************************
@@ -108,12 +181,23 @@ static uint32_t 	    spi_bpws[3]		= {0,};
 *********************************************************************************************************
 */
 int rpi_gpio_setup(void);
+int rpi_gpio_setup_backend(int backend, const char *chip);
+int rpi_gpio_backend(void);
 int rpi_gpio_direction(unsigned int pin_num, unsigned int mode);
+int rpi_gpio_request_lines(unsigned int set_mask);
 int rpi_gpio_alt_func(unsigned int pin_num, unsigned int mode);
 int rpi_gpio_write(unsigned int pin_num, unsigned int status);
+int rpi_gpio_write_mask(unsigned int set_mask, unsigned int clr_mask);
 int rpi_gpio_read(unsigned int pin_num);
 int rpi_spi_setup(int channel, int mode, int bits_per_word, int speed, int delay);
+int rpi_spi_setup_bus(int channel, int bus, int cs, int mode, int bits_per_word, int speed, int delay);
 int rpi_spi_data_rw(int channel, unsigned char *data, int len);
+int rpi_spi_data_rw_multi(int channel, unsigned char *data, int len, int count);
 void rpi_spi_close(void);
+int rpi_spi_set_budget(int channel, int budget_us, int retries);
+int rpi_spi_transfer(int channel, unsigned char *data, int len, int count);
+void rpi_spi_note_error(int channel);
+int rpi_spi_state(int channel);
+int rpi_spi_get_health(int channel, struct spi_health *health);
 
 #endif
@@ -0,0 +1,11 @@
+#!/bin/sh
+# perf 로 raspi_motor USDT tracepoint 기록
+# $ sudo scripts/perf_probe.sh [초]
+#   > perf.data 생성 후 perf script 로 확인
+BIN=${BIN:-./3_motor_example.out}
+SEC=${1:-5}
+
+perf buildid-cache --add "$BIN" || exit 1
+perf probe 'sdt_raspi_motor:*' > /dev/null || exit 1
+perf record -e 'sdt_raspi_motor:*' -a -- sleep "$SEC"
+perf probe -d 'sdt_raspi_motor:*'
@@ -13,8 +13,18 @@
 #include <unistd.h> 
 #include <stdint.h> 
 #include <signal.h>
+#include <string.h>
+#include <errno.h>
 #include "rpi_func.h"
 #include "motor_func.h"
+#include "motor_comp.h"
+#include "gain_sched.h"
+#include "axis_rt.h"
+#include "motor_fra.h"
+#include "flight_rec.h"
+#include "estop.h"
+#include "rate_mgr.h"
+#include "ctrl_loop.h"
 
 static void pabort(const char *s)
 {
@@ -22,17 +32,164 @@ static void pabort(const char *s)
     abort();
 }
 
+/*
+* 시그널 핸들러 (async-signal-safe 함수만 사용)
+* 브레이크와 DAC 를 즉시 정지시키고 정지 지연 시간을 출력.
+* SIGINT, SIGTERM 은 바로 종료하고 SIGSEGV 등은 기본 동작(core dump)으로 다시 전달 (SA_RESETHAND).
+* loop_init() 이후의 SIGINT, SIGTERM 은 block 되어 signalfd 로 받으므로 이 핸들러는 초기화 중에만 사용됨.
+*/
 void signalHandler(int signo)
 {
-    rpi_spi_close();
-    pabort("SIGINT");
+    estop_fire(ESTOP_SRC_SIGNAL);
+    estop_report(STDERR_FILENO);
+    if( (signo == SIGINT) | (signo == SIGTERM) )
+        _exit(128 + signo);
+    raise(signo);
+}
+
+/*
+*********************************************************************************************************
+*                                        EVENT LOOP CALLBACK
+*********************************************************************************************************
+*/
+static int ctrl_ref = 360;     // 목표 각도 (degree)
+
+/*
+* 제어 tick (ctrl_loop.c 의 timerfd 주기로 호출)
+*/
+static int ctrl_tick(void *arg)
+{
+    (void)arg;
+
+    // 속도 제어
+    //speed_control(20,LEFT_WHEEL,FORWARD);
+    // 각도 제어
+    pos_control(ctrl_ref,LEFT_WHEEL,FORWARD);
+
+    // spi 버스 오류가 계속되어 복구되지 않으면 정지
+    if(motor_health(LEFT_WHEEL) == SPI_ST_FAILED){
+        printf("SPI bus failed, stop\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+* 표준 입력 명령 (한 줄에 명령 1개)
+*   ref <degree>    : 목표 각도 변경
+*   brake on|off    : 브레이크
+*   quit            : 종료
+* read() 1번에 줄이 나뉘어 들어올 수 있으므로 줄 단위로 모아서 처리. CTRL_CMD_MAX 를 넘는 줄은 버림.
+* EOF 이면 남은 줄을 처리하고 source 에서 제거됨.
+*/
+#define CTRL_CMD_MAX    128
+
+static char ctrl_cmd_line[CTRL_CMD_MAX];
+static int  ctrl_cmd_len = 0;
+static int  ctrl_cmd_drop = 0;      // 너무 긴 줄, 다음 줄바꿈까지 버림
+
+static void ctrl_command_line(char *line)
+{
+    int val;
+
+    if(sscanf(line, "ref %d", &val) == 1)       ctrl_ref = val;
+    else if(strcmp(line, "brake on") == 0)      brake_wheel(LEFT_WHEEL, BREAK_ON);
+    else if(strcmp(line, "brake off") == 0)     brake_wheel(LEFT_WHEEL, BREAK_OFF);
+    else if(strcmp(line, "quit") == 0)          loop_stop();
+    else{
+        printf("unknown command : %s\n", line);
+        return;
+    }
+    rate_command();
+    loop_request_tick();
+}
+
+static int ctrl_command(int fd, void *arg)
+{
+    char buf[CTRL_CMD_MAX];
+    ssize_t n, k;
+
+    (void)arg;
+    if((n = read(fd, buf, sizeof(buf))) < 0) return ( (errno == EAGAIN) | (errno == EINTR) ) ? 0 : -1;
+
+    for(k=0; k<n; k++){
+        if( (buf[k] != '\n') & (buf[k] != '\r') ){
+            if(ctrl_cmd_len < CTRL_CMD_MAX - 1)     ctrl_cmd_line[ctrl_cmd_len++] = buf[k];
+            else if(!ctrl_cmd_drop){
+                printf("command too long, dropped\n");
+                ctrl_cmd_drop = 1;
+            }
+            continue;
+        }
+        ctrl_cmd_line[ctrl_cmd_len] = 0;
+        if( (ctrl_cmd_len > 0) & !ctrl_cmd_drop ) ctrl_command_line(ctrl_cmd_line);
+        ctrl_cmd_len    = 0;
+        ctrl_cmd_drop   = 0;
+    }
+
+    //EOF : 줄바꿈 없이 끝난 마지막 줄 처리 후 제거
+    if(n == 0){
+        ctrl_cmd_line[ctrl_cmd_len] = 0;
+        if( (ctrl_cmd_len > 0) & !ctrl_cmd_drop ) ctrl_command_line(ctrl_cmd_line);
+        ctrl_cmd_len    = 0;
+        ctrl_cmd_drop   = 0;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+* SIGHUP : LOOP_CONF_PATH 다시 읽기 (한 줄에 key = value, '#' 주석)
+*   ref             : 목표 각도 (degree)
+*   oversample_us   : 엔코더 oversampling 시간 (motor_set_oversample(), 0 이면 사용 안 함)
+*   spi_budget_us   : SPI 전송 시간 제한 (rpi_spi_set_budget())
+*/
+static void ctrl_reload(void *arg)
+{
+    FILE *fp;
+    char line[128], key[32];
+    int val, ch;
+
+    (void)arg;
+    if((fp = fopen(LOOP_CONF_PATH, "r")) == NULL){
+        printf("%s open error\n", LOOP_CONF_PATH);
+        return;
+    }
+    while(fgets(line, sizeof(line), fp) != NULL){
+        if(line[0] == '#') continue;
+        if(sscanf(line, " %31[^= ] = %d", key, &val) != 2) continue;
+
+        if(strcmp(key, "ref") == 0)
+            ctrl_ref = val;
+        else if(strcmp(key, "oversample_us") == 0)
+            motor_set_oversample(val);
+        else if(strcmp(key, "spi_budget_us") == 0){
+            for(ch=SPI_DAC_CHANNEL; ch<=SPI_ENC_R_CHANNEL; ch++)
+                rpi_spi_set_budget(ch, val, SPI_XFER_RETRY);
+        }
+        else
+            printf("unknown config : %s\n", key);
+    }
+    fclose(fp);
+    printf("%s reloaded, ref : %d\n", LOOP_CONF_PATH, ctrl_ref);
 }
 
 int main(void) { 
-    int ret,i=0,dac=0;
+    int ret,i=0;
+    size_t sig;
+    int stop_signals[] = {SIGINT, SIGTERM, SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+    struct sigaction sa;
+    struct estop_stat stat;
+    struct rate_stat rstat;
+    struct spi_health hstat;
 
-    //SIGINT 시그널을 받으면 signalhandler를 실행하도록 설정
-    signal(SIGINT,signalHandler);
+    //종료 시그널을 받으면 signalhandler를 실행하도록 설정
+    sa.sa_handler = signalHandler;
+    sa.sa_flags = SA_RESETHAND;
+    sigfillset(&sa.sa_mask);
+    for(sig=0; sig<sizeof(stop_signals)/sizeof(int); sig++){
+        sigaction(stop_signals[sig],&sa,NULL);
+    }
 	if((ret = rpi_gpio_setup()) < 0)
         pabort("<1>Hardware init error");
     else 
@@ -59,7 +216,73 @@ int main(void) {
         pabort("<5>Right Encoder setup error");
     else
         printf("<5>Right Encoder setup done..\n");
+
+    //첫 변화량이 튀지 않도록 유효한 엔코더 값으로 초기화
+    if( (encoder_seed(LEFT_WHEEL) < 0) | (encoder_seed(RIGHT_WHEEL) < 0) )
+        printf("<5>Encoder seed error, no valid frame..\n");
+
+    //비상 정지 프레임/브레이크 mask 준비
+    if((ret = estop_init())<0)
+        pabort("<6>Emergency stop init error");
+    else
+        printf("<6>Emergency stop init done..\n");
+
+    //DAC 데드존/마찰 보상 값 측정 (두 바퀴 모두 실제로 회전함, 끝나면 브레이크 걸림)
+    comp_init();
+    if( ((ret = comp_identify(LEFT_WHEEL,0))<0) | (comp_identify(RIGHT_WHEEL,0)<0) )
+        printf("<7>DAC compensation identify error, use default..\n");
+    else
+        printf("<7>DAC compensation identify done..\n");
+
+    //PI gain scheduling (gs_init()은 모든 점을 Kp, Ki 로 채우므로 기존 동작과 같음)
+    gs_init();
 #if 0
+    //예 : 저속에서는 Kp 를 높이고 고속으로 갈수록 낮춤. 위치 오차가 클수록 Ki 를 낮춰 적분 windup 억제.
+    {
+        struct gain_table gt;
+        int x, y;
+
+        gs_table_init(&gt, GS_AXIS_ERR, GS_VEL_MAX_DEFAULT, 90);
+        for(y=0; y<GS_AX2_N; y++){
+            for(x=0; x<GS_VEL_N; x++){
+                gt.g[y][x].kp = 5.0 - 2.5 * x / (GS_VEL_N - 1);
+                gt.g[y][x].ki = Ki / (1 + y);
+            }
+        }
+        gs_set(LEFT_WHEEL, GS_CTRL_POS, &gt);
+        gs_set(RIGHT_WHEEL, GS_CTRL_POS, &gt);
+    }
+#endif
+
+    //flight recorder (이전 기록은 FREC_PATH.prev 로 보존, frec_dump.out 으로 확인)
+    if((ret = frec_open(FREC_PATH,FREC_CAPACITY))<0)
+        printf("<8>Flight recorder open error..\n");
+    else
+        printf("<8>Flight recorder open done..\n");
+
+    //이벤트 루프 (SIGINT, SIGTERM, SIGHUP 을 block 하므로 스레드 생성 전에 초기화)
+    if((ret = loop_init())<0)
+        pabort("<9>Event loop init error");
+    else
+        printf("<9>Event loop init done..\n");
+
+    //제어 출력(writeDAC)이 ESTOP_WDT_MS 이상 멈추면 비상 정지
+    if((ret = estop_watchdog_start(ESTOP_WDT_MS))<0)
+        pabort("<10>Watchdog start error");
+    else
+        printf("<10>Watchdog start done..\n");
+
+    //엔코더 oversampling : tick 당 바퀴별 200us 안에서 여러 프레임을 읽어 중앙값 사용.
+    //SPI_ENC_SPEED(10KHz)에서는 프레임 1개가 2.4ms 이므로 엔코더 클럭을 올린 경우에만 사용.
+    //motor_set_oversample(200);
+
+    //제어 루프 주기 관리 : 정지 상태가 유지되면 RATE_IDLE_US 주기로 낮추고, 명령/움직임이 있으면 바로 복귀
+    if((ret = rate_init(RATE_FULL_US,RATE_IDLE_US,RATE_IDLE_TICKS))<0)
+        pabort("<11>Rate manager init error");
+    else
+        printf("<11>Rate manager init done..\n");
+#if 0
+    int dac=0;
     while(1){
         printf("input value \n");
         scanf("%x",&dac);
@@ -70,18 +293,60 @@ int main(void) {
 #endif
 
 #if 1
-//PI 제어 테스트
-     set_direction(LEFT_WHEEL,FORWARD);
+//PI 제어 (이벤트 루프) : 표준 입력으로 명령, SIGHUP 으로 설정 다시 읽기, SIGINT/SIGTERM 으로 정지
+    brake_wheel(LEFT_WHEEL,BREAK_OFF);
+    set_direction(LEFT_WHEEL,FORWARD);
+    loop_set_tick(ctrl_tick,NULL);
+    loop_set_reload(ctrl_reload,NULL);
+    //stdin 이 epoll 에 등록할 수 없는 fd(일반 파일, /dev/null 등 systemd 기본값)이면 명령 입력 없이 동작
+    if(loop_add_source(STDIN_FILENO,ctrl_command,NULL) < 0)
+        printf("stdin commands disabled\n");
+    if((ret = loop_run()) > 0)
+        printf("signal %d, stop\n", ret);
+#endif
+// 두 바퀴 동기 제어 테스트 (직진, 원호 주행시 ratio 변경)
+#if 0
+    brake_wheel(LEFT_WHEEL,BREAK_OFF);
+    brake_wheel(RIGHT_WHEEL,BREAK_OFF);
     while(i < 2000){
-    
-        // 속도 제어
-        //speed_control(20,LEFT_WHEEL,FORWARD);
-        // 각도 제어
-        pos_control(360,LEFT_WHEEL,FORWARD);
-
-    //    encoder_read(LEFT_WHEEL);
+        sync_control(360,FORWARD,1.0);
         i++;
-        usleep(1000);
+        rate_wait();
+    }
+#endif
+// 축별 실시간 스레드 테스트 (왼쪽 바퀴 spidev0.x / 오른쪽 바퀴 spidev1.x, 각각 코어 2, 3에 고정)
+#if 0
+    if( (rpi_spi_setup_bus(SPI_BUS1_DAC_CHANNEL,1,0,SPI_MODE,SPI_BPW,SPI_DAC_SPEED,SPI_DELAY) < 0) | 
+        (rpi_spi_setup_bus(SPI_BUS1_ENC_CHANNEL,1,1,SPI_MODE,SPI_BPW,SPI_ENC_SPEED,SPI_DELAY) < 0) )
+        pabort("SPI bus 1 setup error");
+    motor_set_spi(RIGHT_WHEEL,SPI_BUS1_DAC_CHANNEL,SPI_BUS1_ENC_CHANNEL);
+    encoder_seed(RIGHT_WHEEL);
+    estop_init();
+
+    brake_wheel(LEFT_WHEEL,BREAK_OFF);
+    brake_wheel(RIGHT_WHEEL,BREAK_OFF);
+    axis_set_ref(axis_rt_add(LEFT_WHEEL,AXIS_POS,2),360,FORWARD);
+    axis_set_ref(axis_rt_add(RIGHT_WHEEL,AXIS_POS,3),360,FORWARD);
+    if(axis_rt_start() < 0)
+        pabort("axis thread start error");
+    sleep(2);
+    axis_rt_stop();
+#endif
+// 주파수 응답 분석 (Bode 데이터와 모터 모델을 fra_bode.csv 로 저장)
+#if 0
+    {
+        struct fra_cfg cfg;
+        struct fra_point res[FRA_MAX_FREQ];
+        struct fra_model model;
+        int n;
+
+        fra_default_cfg(&cfg);
+        if((n = fra_run(LEFT_WHEEL,&cfg,res)) < 0)
+            pabort("FRA run error");
+        if(fra_fit_model(res,n,&model) == 0)
+            printf("FRA model K : %.3f tau : %.4f theta : %.4f bandwidth : %.1f Hz crossover : %.1f Hz PM : %.1f deg\n",\
+                    model.K, model.tau, model.theta, model.bandwidth, model.crossover, model.phase_margin);
+        fra_export("fra_bode.csv",res,n,&model);
     }
 #endif
 // 엔코더 읽어오기.
@@ -96,6 +361,21 @@ int main(void) {
     }
     writeDAC(DAC_ADDR_ALL,DAC_CMD_WRUP,0x10);
 #endif
+    //정상 종료시에도 같은 경로로 정지
+    estop_watchdog_stop();
+    estop_fire(ESTOP_SRC_CONTROL);
+    estop_get_stat(&stat);
+    printf("Stop latency brake : %ld ns DAC : %ld ns\n", stat.brake_ns, stat.dac_ns);
+    rate_get_stat(&rstat);
+    printf("Loop ticks full : %lu idle : %lu wakeups : %lu\n", rstat.full_ticks, rstat.idle_ticks, rstat.wakeups);
+    for(i=SPI_DAC_CHANNEL; i<=SPI_ENC_R_CHANNEL; i++){
+        rpi_spi_get_health(i, &hstat);
+        printf("SPI %d health %d ok %lu fail %lu retry %lu over %lu speed %u Hz\n", i, hstat.health,\
+                                       hstat.ok, hstat.fail, hstat.retry, hstat.over, hstat.speed);
+    }
+
+    loop_close();
+    frec_close();
     rpi_spi_close();
 	return 0;
 }	